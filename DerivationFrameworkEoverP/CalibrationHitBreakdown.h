@@ -0,0 +1,65 @@
+/*
+ * @file     CalibrationHitBreakdown.h
+ * @brief    Accumulator of calibration-hit energies by (hit kind x attribution category x energy type x sampling).
+ *           The hit kinds are the active and inactive hit containers, the categories are the signal particle and the
+ *           background classes, and the energy types are EM, NonEM, Invisible and Escaped. Each (kind, category, type)
+ *           is a fixed-width row of per-sampling energies.
+ */
+#ifndef DERIVATIONFRAMEWORK_CALIBRATIONHITBREAKDOWN_H
+#define DERIVATIONFRAMEWORK_CALIBRATIONHITBREAKDOWN_H
+
+#include "DerivationFrameworkEoverP/SamplingEnergyRow.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace DerivationFramework {
+
+  class CalibrationHitBreakdown {
+    public:
+      enum HitKind {Active = 0, Inactive = 1};
+      static constexpr unsigned int nHitKinds = 2;
+      static constexpr unsigned int nEnergyTypes = 4;
+
+      explicit CalibrationHitBreakdown(unsigned int nCategories = 0) {resize(nCategories);}
+
+      /** Set the number of categories and clear every energy */
+      void resize(unsigned int nCategories) {
+        m_nCategories = nCategories;
+        m_values.assign((std::size_t)nHitKinds * nCategories * nEnergyTypes * SamplingEnergyRow::width, 0.0);
+      }
+
+      void clear() {std::fill(m_values.begin(), m_values.end(), 0.0);}
+
+      unsigned int nCategories() const {return m_nCategories;}
+
+      float* row(unsigned int kind, unsigned int category, unsigned int energyType) {return m_values.data() + offset(kind, category, energyType);}
+      const float* row(unsigned int kind, unsigned int category, unsigned int energyType) const {return m_values.data() + offset(kind, category, energyType);}
+
+      float at(unsigned int kind, unsigned int category, unsigned int energyType, unsigned int sampling) const {
+        return m_values[offset(kind, category, energyType) + sampling];
+      }
+
+      /** Add the four energy types of a hit in the given sampling */
+      void addHit(unsigned int kind, unsigned int category, unsigned int sampling, const float* energies) {
+        float* first = m_values.data() + offset(kind, category, 0) + sampling;
+        for (unsigned int energyType = 0; energyType < nEnergyTypes; energyType++) first[energyType * SamplingEnergyRow::width] += energies[energyType];
+      }
+
+      /** Add another breakdown with the same number of categories */
+      void add(const CalibrationHitBreakdown& other) {
+        for (std::size_t i = 0; i < m_values.size(); i += SamplingEnergyRow::width) SamplingEnergyRow::add(m_values.data() + i, other.m_values.data() + i);
+      }
+
+    private:
+      std::size_t offset(unsigned int kind, unsigned int category, unsigned int energyType) const {
+        return (((std::size_t)kind * m_nCategories + category) * nEnergyTypes + energyType) * SamplingEnergyRow::width;
+      }
+
+      unsigned int m_nCategories = 0;
+      std::vector<float> m_values;
+  };
+
+} // Derivation Framework
+#endif
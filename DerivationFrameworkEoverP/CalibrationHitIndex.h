@@ -0,0 +1,78 @@
+/*
+ * @file     CalibrationHitIndex.h
+ * @brief    Per-event index of a CaloCalibrationHitContainer by (cell ID, particle barcode). The energies of the hits
+ *           sharing a key are summed when the index is built, so that each lookup is a single hash probe.
+ *           The summed hits of each cell are also stored contiguously, to iterate over all of the particles hitting a cell.
+ */
+#ifndef DERIVATIONFRAMEWORK_CALIBRATIONHITINDEX_H
+#define DERIVATIONFRAMEWORK_CALIBRATIONHITINDEX_H
+
+#include "DerivationFrameworkEoverP/FlatHashMap.h"
+#include "Identifier/Identifier.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class CaloCalibrationHitContainer;
+
+namespace DerivationFramework {
+
+  struct CalibrationHitKey {
+    std::uint64_t cellID = 0;
+    unsigned int barcode = 0;
+    bool operator==(const CalibrationHitKey& other) const {return cellID == other.cellID && barcode == other.barcode;}
+  };
+
+  struct CalibrationHitKeyHash {
+    std::size_t operator()(const CalibrationHitKey& key) const {
+      return Mixed64Hash()(key.cellID ^ ((std::uint64_t)key.barcode * 0x9e3779b97f4a7c15ULL));
+    }
+  };
+
+  /** Summed energies of the calibration hits: EM, NonEM, Invisible, Escaped */
+  struct CalibrationHitEnergies {
+    float energy[4] = {0.0, 0.0, 0.0, 0.0};
+  };
+
+  class CalibrationHitIndex {
+    public:
+      /** Index every hit of the container. A null container gives an empty index. */
+      void build(const CaloCalibrationHitContainer* hits);
+
+      /** Summed energies of the hits of the particle in the cell, or nullptr if there are none */
+      const CalibrationHitEnergies* find(const Identifier& cellID, unsigned int barcode) const {return find(cellID.get_compact(), barcode);}
+      const CalibrationHitEnergies* find(std::uint64_t cellID, unsigned int barcode) const {
+        CalibrationHitKey key;
+        key.cellID = cellID;
+        key.barcode = barcode;
+        return m_energies.find(key);
+      }
+
+      /** The summed hits of every particle in the cell are cellHitBarcode(i) / cellHitEnergies(i) for i in [first, last).
+       *  Returns false if the cell has no hits.
+       */
+      bool cellHits(std::uint64_t cellID, std::size_t& first, std::size_t& last) const {
+        const unsigned int* cell = m_cellIndex.find(cellID);
+        if (!cell) return false;
+        first = m_cellStart[*cell];
+        last = m_cellStart[*cell + 1];
+        return true;
+      }
+      unsigned int cellHitBarcode(std::size_t i) const {return m_cellHitBarcode[i];}
+      const CalibrationHitEnergies& cellHitEnergies(std::size_t i) const {return m_cellHitEnergies[i];}
+
+      std::size_t size() const {return m_energies.size();}
+
+    private:
+      FlatHashMap<CalibrationHitKey, CalibrationHitEnergies, CalibrationHitKeyHash> m_energies;
+
+      //Summed hits grouped by cell: the hits of cell c are m_cellStart[c] ... m_cellStart[c+1]-1
+      FlatHashMap<std::uint64_t, unsigned int> m_cellIndex;
+      std::vector<unsigned int> m_cellStart;
+      std::vector<unsigned int> m_cellHitBarcode;
+      std::vector<CalibrationHitEnergies> m_cellHitEnergies;
+  };
+
+} // Derivation Framework
+#endif
@@ -0,0 +1,52 @@
+/*
+ * @file     CaloCellEnergyArray.h
+ * @brief    Dense per-event copy of the cell energies, indexed by calo cell IdentifierHash, with a status bit mask and the
+ *           raw quality and provenance words. Filled in one pass over the CaloCellContainer, so that cone sums gather from
+ *           contiguous memory instead of dereferencing the CaloCell objects.
+ */
+#ifndef DERIVATIONFRAMEWORK_CALOCELLENERGYARRAY_H
+#define DERIVATIONFRAMEWORK_CALOCELLENERGYARRAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DerivationFramework {
+
+  struct CaloCellEnergyArray {
+
+    enum Flag : std::uint8_t {
+      Present = 1 << 0,      //the cell is in this event's container
+      BadCell = 1 << 1,      //CaloCell::badcell()
+      Significant = 1 << 2   //|E| above the noise significance threshold
+    };
+
+    void resize(std::size_t nHashes) {
+      energy.assign(nHashes, 0.0);
+      flags.assign(nHashes, 0);
+      quality.assign(nHashes, 0);
+      provenance.assign(nHashes, 0);
+    }
+
+    std::size_t size() const {return energy.size();}
+    bool isPresent(std::size_t hash) const {return flags[hash] & Present;}
+
+    bool isBad(std::size_t hash) const {return flags[hash] & BadCell;}
+    bool isSignificant(std::size_t hash) const {return flags[hash] & Significant;}
+    void markSignificant(std::size_t hash) {flags[hash] |= Significant;}
+
+    void set(std::size_t hash, float cellEnergy, bool badCell, std::uint16_t cellQuality, std::uint16_t cellProvenance) {
+      energy[hash] = cellEnergy;
+      flags[hash] = Present | (badCell ? BadCell : 0);
+      quality[hash] = cellQuality;
+      provenance[hash] = cellProvenance;
+    }
+
+    std::vector<float> energy;
+    std::vector<std::uint8_t> flags;
+    std::vector<std::uint16_t> quality;
+    std::vector<std::uint16_t> provenance;
+  };
+
+} // Derivation Framework
+#endif
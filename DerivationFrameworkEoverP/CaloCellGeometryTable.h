@@ -0,0 +1,56 @@
+/*
+ * @file     CaloCellGeometryTable.h
+ * @brief    Static table of the calorimeter cell centres, indexed by calo cell IdentifierHash, with one eta-phi grid
+ *           per sampling. Built once per geometry (conditions IOV) from the CaloDetDescrManager, so that a cone query only
+ *           touches the cells near the extrapolated track instead of the whole CaloCellContainer.
+ */
+#ifndef DERIVATIONFRAMEWORK_CALOCELLGEOMETRYTABLE_H
+#define DERIVATIONFRAMEWORK_CALOCELLGEOMETRYTABLE_H
+
+#include "DerivationFrameworkEoverP/EtaPhiGridIndex.h"
+
+#include <cstddef>
+#include <vector>
+
+class CaloDetDescrManager;
+
+namespace DerivationFramework {
+
+  class CaloCellGeometryTable {
+    public:
+      /** binSize: eta-phi bin size of the per-sampling grids
+       *  nSamplings: cells of samplings >= nSamplings are not indexed
+       */
+      CaloCellGeometryTable(float binSize, unsigned int nSamplings);
+
+      /** Fill the table from every detector element of the manager. Elements at eta or phi -999 are left out. */
+      void build(const CaloDetDescrManager& caloMgr);
+
+      /** Fill the table from cell centres given by hash. Cells with sampling >= nSamplings are left out. */
+      void build(std::size_t nHashes, const float* eta, const float* phi, const unsigned int* sampling);
+
+      /** Append to hashes the hash of every cell of the sampling that may lie within radius of (eta, phi).
+       *  As for EtaPhiGridIndex, this is a superset: callers must apply their own deltaR test.
+       */
+      void query(unsigned int sampling, float eta, float phi, float radius, std::vector<unsigned int>& hashes) const {
+        m_grid.query(eta, phi, radius, sampling, hashes);
+      }
+
+      std::size_t size() const {return m_eta.size();}
+      bool isIndexed(std::size_t hash) const {return hash < m_sampling.size() && m_sampling[hash] < m_nSamplings;}
+      float eta(std::size_t hash) const {return m_eta[hash];}
+      float phi(std::size_t hash) const {return m_phi[hash];}
+      unsigned int sampling(std::size_t hash) const {return m_sampling[hash];}
+
+    private:
+      unsigned int m_nSamplings;
+      EtaPhiGridIndex m_grid;
+
+      std::vector<float> m_eta;
+      std::vector<float> m_phi;
+      //nSamplings for the hashes that are not indexed
+      std::vector<unsigned int> m_sampling;
+  };
+
+} // Derivation Framework
+#endif
@@ -0,0 +1,71 @@
+/*
+ * @file     CaloClusterSnapshot.h
+ * @brief    Struct-of-arrays copy of the cluster quantities used in track-cluster matching.
+ *           Filled once per event, so that the per-track loops read contiguous arrays instead of going through the aux store.
+ */
+#ifndef DERIVATIONFRAMEWORK_CALOCLUSTERSNAPSHOT_H
+#define DERIVATIONFRAMEWORK_CALOCLUSTERSNAPSHOT_H
+
+#include <cstddef>
+#include <vector>
+
+#include "DerivationFrameworkEoverP/SamplingEnergyRow.h"
+
+namespace DerivationFramework {
+
+  struct CaloClusterSnapshot {
+
+    void resize(std::size_t nClusters, unsigned int nSamplings) {
+      size = nClusters;
+      samplings = nSamplings;
+      rawEta.assign(nClusters, 0.0);
+      rawPhi.assign(nClusters, 0.0);
+      rawE.assign(nClusters, 0.0);
+      calEta.assign(nClusters, 0.0);
+      calPhi.assign(nClusters, 0.0);
+      calE.assign(nClusters, 0.0);
+      e.assign(nClusters, 0.0);
+      sampleEnergy.assign(nClusters * SamplingEnergyRow::width, 0.0);
+      maxEnergyLayer.assign(nClusters, nSamplings);
+      maxLayerEnergy.assign(nClusters, 0.0);
+      lambdaCenter.assign(nClusters, 0.0);
+      emProbability.assign(nClusters, 0.0);
+      firstEnergyDensity.assign(nClusters, 0.0);
+      deltaAlpha.assign(nClusters, 0.0);
+      secondLambda.assign(nClusters, 0.0);
+    }
+
+    /** Energy of cluster i in the given sampling, at EM scale */
+    float eSample(std::size_t i, unsigned int sampling) const {return sampleEnergy[i * SamplingEnergyRow::width + sampling];}
+    const float* eSampleRow(std::size_t i) const {return &sampleEnergy[i * SamplingEnergyRow::width];}
+    float* eSampleRow(std::size_t i) {return &sampleEnergy[i * SamplingEnergyRow::width];}
+
+    std::size_t size = 0;
+    unsigned int samplings = 0;
+
+    //Kinematics at EM (raw) and LCW (cal) scale. e is the energy in the default signal state of the container.
+    std::vector<float> rawEta;
+    std::vector<float> rawPhi;
+    std::vector<float> rawE;
+    std::vector<float> calEta;
+    std::vector<float> calPhi;
+    std::vector<float> calE;
+    std::vector<float> e;
+
+    //Row-major (cluster x sampling) matrix of the EM scale energy per sampling. Rows are SamplingEnergyRow::width wide, the padding lanes are zero.
+    std::vector<float> sampleEnergy;
+
+    //Most energetic sampling of each cluster (up to TileExt2) and its energy. Clusters without one have maxEnergyLayer = samplings.
+    std::vector<unsigned int> maxEnergyLayer;
+    std::vector<float> maxLayerEnergy;
+
+    //Cluster moments 501 (CENTER_LAMBDA), 900 (EM_PROBABILITY), 804 (FIRST_ENG_DENS), 303 (DELTA_ALPHA), 202 (SECOND_LAMBDA)
+    std::vector<float> lambdaCenter;
+    std::vector<float> emProbability;
+    std::vector<float> firstEnergyDensity;
+    std::vector<float> deltaAlpha;
+    std::vector<float> secondLambda;
+  };
+
+} // Derivation Framework
+#endif
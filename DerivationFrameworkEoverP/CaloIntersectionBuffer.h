@@ -0,0 +1,77 @@
+/*
+ * @file     CaloIntersectionBuffer.h
+ * @brief    Per-event flat buffer of the track-calorimeter layer intersections. Each intersection is a small record
+ *           copied out of the calo extension, and the records of a track are stored contiguously.
+ */
+#ifndef DERIVATIONFRAMEWORK_CALOINTERSECTIONBUFFER_H
+#define DERIVATIONFRAMEWORK_CALOINTERSECTIONBUFFER_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace DerivationFramework {
+
+  struct CaloIntersectionRecord {
+    unsigned int sampling = 0;
+    bool isEntry = false;
+    float x = 0.0;
+    float y = 0.0;
+    float z = 0.0;
+    float eta = 0.0;
+    float phi = 0.0;
+    //Distance from the first intersection of the track, along the straight segments joining its intersections (mm)
+    float pathLength = 0.0;
+  };
+
+  class CaloIntersectionBuffer {
+    public:
+      /** Remove all of the records, and make room for tracks 0..nTracks-1 */
+      void reset(std::size_t nTracks) {
+        m_records.clear();
+        m_first.assign(nTracks, 0);
+        m_last.assign(nTracks, 0);
+      }
+
+      /** Start the records of a track. The records of a track must be added before those of the next one. */
+      void beginTrack(std::size_t track) {
+        m_first[track] = m_records.size();
+        m_last[track] = m_records.size();
+      }
+
+      /** Add an intersection of the current track */
+      void add(std::size_t track, unsigned int sampling, bool isEntry, float x, float y, float z, float eta, float phi) {
+        CaloIntersectionRecord record;
+        record.sampling = sampling;
+        record.isEntry = isEntry;
+        record.x = x;
+        record.y = y;
+        record.z = z;
+        record.eta = eta;
+        record.phi = phi;
+        if (m_last[track] > m_first[track]) {
+          const CaloIntersectionRecord& previous = m_records.back();
+          float dx = x - previous.x;
+          float dy = y - previous.y;
+          float dz = z - previous.z;
+          record.pathLength = previous.pathLength + std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+        m_records.push_back(record);
+        m_last[track] = m_records.size();
+      }
+
+      /** The records of the track are record(i) for i in [first(track), last(track)), in the order of the extension */
+      std::size_t first(std::size_t track) const {return m_first[track];}
+      std::size_t last(std::size_t track) const {return m_last[track];}
+      const CaloIntersectionRecord& record(std::size_t i) const {return m_records[i];}
+
+      std::size_t size() const {return m_records.size();}
+
+    private:
+      std::vector<CaloIntersectionRecord> m_records;
+      std::vector<std::size_t> m_first;
+      std::vector<std::size_t> m_last;
+  };
+
+} // Derivation Framework
+#endif
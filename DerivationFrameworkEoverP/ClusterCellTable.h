@@ -0,0 +1,48 @@
+/*
+ * @file     ClusterCellTable.h
+ * @brief    Per-event cell membership of the clusters: the compact cell IDs of each cluster, sorted, with their sampling.
+ *           Filled on first use for the clusters that are matched to a track, and shared by all of the tracks.
+ */
+#ifndef DERIVATIONFRAMEWORK_CLUSTERCELLTABLE_H
+#define DERIVATIONFRAMEWORK_CLUSTERCELLTABLE_H
+
+#include "xAODCaloEvent/CaloCluster.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DerivationFramework {
+
+  class ClusterCellTable {
+    public:
+      struct Member {
+        std::uint64_t cellID;
+        unsigned int sampling;
+      };
+
+      /** Forget every cluster, for a container of nClusters clusters */
+      void reset(std::size_t nClusters);
+
+      /** Record the cells of the cluster, unless they are already recorded. Clusters without cell links have no cells. */
+      void fill(std::size_t clusterIndex, const xAOD::CaloCluster* cluster);
+
+      bool isFilled(std::size_t clusterIndex) const {return m_first[clusterIndex] != s_notFilled;}
+
+      /** The cells of a filled cluster, sorted by cell ID */
+      const Member* begin(std::size_t clusterIndex) const {return m_members.data() + m_first[clusterIndex];}
+      const Member* end(std::size_t clusterIndex) const {return m_members.data() + m_first[clusterIndex] + m_count[clusterIndex];}
+
+      /** Whether the cell belongs to the filled cluster (binary search) */
+      bool contains(std::size_t clusterIndex, std::uint64_t cellID) const;
+
+    private:
+      static constexpr unsigned int s_notFilled = ~0u;
+
+      std::vector<unsigned int> m_first;
+      std::vector<unsigned int> m_count;
+      std::vector<Member> m_members;
+  };
+
+} // Derivation Framework
+#endif
@@ -0,0 +1,46 @@
+/*
+ * @file     ClusterHitBreakdownCache.h
+ * @brief    Per-event cache of the calibration-hit breakdown of each cluster, keyed by (cluster index, signal barcode).
+ *           A cluster matched to several tracks of the same particle, or to several cones, is only summed once.
+ *           There is at most one entry per matched (cluster, barcode) pair.
+ */
+#ifndef DERIVATIONFRAMEWORK_CLUSTERHITBREAKDOWNCACHE_H
+#define DERIVATIONFRAMEWORK_CLUSTERHITBREAKDOWNCACHE_H
+
+#include "DerivationFrameworkEoverP/CalibrationHitBreakdown.h"
+#include "DerivationFrameworkEoverP/FlatHashMap.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace DerivationFramework {
+
+  class ClusterHitBreakdownCache {
+    public:
+      explicit ClusterHitBreakdownCache(unsigned int nCategories) : m_nCategories(nCategories) {}
+
+      /** Cached breakdown, or nullptr if the pair has not been summed yet */
+      const CalibrationHitBreakdown* find(unsigned int clusterIndex, unsigned int barcode) const {
+        const unsigned int* slot = m_slots.find(key(clusterIndex, barcode));
+        return slot ? &m_breakdowns[*slot] : nullptr;
+      }
+
+      /** New, empty breakdown for the pair, to be filled by the caller. The reference is valid until the next insert. */
+      CalibrationHitBreakdown& insert(unsigned int clusterIndex, unsigned int barcode) {
+        m_slots[key(clusterIndex, barcode)] = m_breakdowns.size();
+        m_breakdowns.emplace_back(m_nCategories);
+        return m_breakdowns.back();
+      }
+
+      std::size_t size() const {return m_breakdowns.size();}
+
+    private:
+      static std::uint64_t key(unsigned int clusterIndex, unsigned int barcode) {return ((std::uint64_t)clusterIndex << 32) | barcode;}
+
+      unsigned int m_nCategories;
+      FlatHashMap<std::uint64_t, unsigned int> m_slots;
+      std::vector<CalibrationHitBreakdown> m_breakdowns;
+  };
+
+} // Derivation Framework
+#endif
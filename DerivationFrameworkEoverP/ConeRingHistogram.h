@@ -0,0 +1,44 @@
+/*
+ * @file     ConeRingHistogram.h
+ * @brief    Per-track (ring x sampling) energy histogram. Ring r holds the objects whose smallest containing cone is r.
+ *           Each object is added once, and a prefix sum over the rings turns the rings into the cumulative cone sums.
+ */
+#ifndef DERIVATIONFRAMEWORK_CONERINGHISTOGRAM_H
+#define DERIVATIONFRAMEWORK_CONERINGHISTOGRAM_H
+
+#include "DerivationFrameworkEoverP/SamplingEnergyRow.h"
+
+#include <vector>
+
+namespace DerivationFramework {
+
+  class ConeRingHistogram {
+    public:
+      /** Set every ring of nRings rings to zero */
+      void reset(unsigned int nRings) {
+        m_nRings = nRings;
+        m_rows.assign(nRings, SamplingEnergyRow::Row{});
+      }
+
+      void add(unsigned int ring, unsigned int sampling, float energy) {m_rows[ring].lane[sampling] += energy;}
+      void addRow(unsigned int ring, const float* row) {SamplingEnergyRow::add(ringRow(ring), row);}
+      void addScaledRow(unsigned int ring, const float* row, float weight) {SamplingEnergyRow::addScaled(ringRow(ring), row, weight);}
+
+      /** Turn the ring contents into cone sums: ring r becomes the sum of the rings 0..r */
+      void accumulate() {
+        for (unsigned int ring = 1; ring < m_nRings; ring++) SamplingEnergyRow::add(ringRow(ring), ringRow(ring - 1));
+      }
+
+      /** Energy in the given sampling of the given ring (or cone, after accumulate()) */
+      float at(unsigned int ring, unsigned int sampling) const {return m_rows[ring].lane[sampling];}
+
+    private:
+      float* ringRow(unsigned int ring) {return m_rows[ring].lane;}
+
+      unsigned int m_nRings = 0;
+      //One aligned row per ring
+      std::vector<SamplingEnergyRow::Row> m_rows;
+  };
+
+} // Derivation Framework
+#endif
@@ -0,0 +1,55 @@
+/*
+ * @file     DeadMaterialHitIndex.h
+ * @brief    Per-event eta-phi index of the dead-material calibration hits. Each hit is placed at the centre of its
+ *           dead-material region bin, with its four energies summed, so that the hits around a track are found
+ *           with a grid lookup instead of a scan of the containers.
+ */
+#ifndef DERIVATIONFRAMEWORK_DEADMATERIALHITINDEX_H
+#define DERIVATIONFRAMEWORK_DEADMATERIALHITINDEX_H
+
+#include "DerivationFrameworkEoverP/EtaPhiGridIndex.h"
+
+#include <cstddef>
+#include <vector>
+
+class CaloCalibrationHitContainer;
+class CaloDM_ID;
+class CaloDmDescrManager;
+
+namespace DerivationFramework {
+
+  class DeadMaterialHitIndex {
+    public:
+      DeadMaterialHitIndex(float binSize = 0.1);
+
+      /** Remove all of the hits */
+      void clear();
+
+      /** Append the hits of a container. A null container adds nothing.
+       *  Hits whose identifier is not in a known dead-material region are skipped.
+       */
+      void add(const CaloCalibrationHitContainer* hits, const CaloDM_ID& dmID, const CaloDmDescrManager& dmManager);
+
+      /** Index the hits added so far. Must be called before query. */
+      void build();
+
+      /** Append the hits in the grid bins overlapping the circle of the given radius, see EtaPhiGridIndex::query */
+      void query(float eta, float phi, float radius, std::vector<unsigned int>& candidates) const {m_grid.query(eta, phi, radius, 0, candidates);}
+
+      std::size_t size() const {return m_energy.size();}
+      float eta(std::size_t i) const {return m_eta[i];}
+      float phi(std::size_t i) const {return m_phi[i];}
+      float energy(std::size_t i) const {return m_energy[i];}
+      unsigned int barcode(std::size_t i) const {return m_barcode[i];}
+
+    private:
+      EtaPhiGridIndex m_grid;
+
+      std::vector<float> m_eta;
+      std::vector<float> m_phi;
+      std::vector<float> m_energy;
+      std::vector<unsigned int> m_barcode;
+  };
+
+} // Derivation Framework
+#endif
@@ -0,0 +1,37 @@
+/*
+ * @file     DeltaRKernel.h
+ * @brief    Vectorised track-object deltaR matching on struct-of-arrays eta/phi inputs.
+ *           Squared distances are compared to a table of squared cone sizes, and each object is assigned the index of
+ *           the smallest cone containing it. The AVX2 version is selected at run time when the CPU supports it.
+ */
+#ifndef DERIVATIONFRAMEWORK_DELTARKERNEL_H
+#define DERIVATIONFRAMEWORK_DELTARKERNEL_H
+
+#include <cstddef>
+
+namespace DerivationFramework {
+
+  namespace DeltaRKernel {
+
+    /** For each of the n objects, compute the squared deltaR to (trackEta, trackPhi) with delta phi wrapped into [0, pi],
+     *  and the index of the first cone with deltaR^2 < coneSizeSquared[cone]. coneSizeSquared must be sorted in increasing order.
+     *  Objects outside of all of the cones get the bin nCones.
+     */
+    void coneBins(const float* eta, const float* phi, std::size_t n, float trackEta, float trackPhi,
+                  const float* coneSizeSquared, unsigned int nCones, int* bins, float* deltaR2);
+
+    /** Portable implementation, also used for the remainder of the AVX2 loop */
+    void coneBinsScalar(const float* eta, const float* phi, std::size_t n, float trackEta, float trackPhi,
+                        const float* coneSizeSquared, unsigned int nCones, int* bins, float* deltaR2);
+
+    /** AVX2 implementation. Falls back to the scalar one when not compiled for x86-64 */
+    void coneBinsAVX2(const float* eta, const float* phi, std::size_t n, float trackEta, float trackPhi,
+                      const float* coneSizeSquared, unsigned int nCones, int* bins, float* deltaR2);
+
+    /** Whether coneBins dispatches to the AVX2 implementation on this machine */
+    bool hasAVX2();
+
+  } // DeltaRKernel
+
+} // Derivation Framework
+#endif
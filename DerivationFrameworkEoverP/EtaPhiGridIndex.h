@@ -0,0 +1,53 @@
+/*
+ * @file     EtaPhiGridIndex.h
+ * @brief    Uniform eta-phi binning of a set of objects (clusters, cells, hits), rebuilt once per event.
+ *           Used to restrict track-object matching to the objects lying near the extrapolated track.
+ */
+#ifndef DERIVATIONFRAMEWORK_ETAPHIGRIDINDEX_H
+#define DERIVATIONFRAMEWORK_ETAPHIGRIDINDEX_H
+
+#include <cstddef>
+#include <vector>
+
+namespace DerivationFramework {
+
+  class EtaPhiGridIndex {
+    public:
+      /** binSize: width of a bin in both eta and phi
+       *  etaMax: objects beyond |eta| = etaMax are kept in the outermost eta bins
+       *  nPartitions: number of independent grids (e.g. one per calorimeter sampling)
+       */
+      EtaPhiGridIndex(float binSize = 0.1, float etaMax = 5.0, unsigned int nPartitions = 1);
+
+      /** Index the objects 0..n-1. partition may be nullptr, in which case every object goes to partition 0.
+       *  Objects with a partition outside [0, nPartitions) are not indexed.
+       */
+      void build(std::size_t n, const float* eta, const float* phi, const unsigned int* partition = nullptr);
+
+      /** Append to candidates the index of every object of the given partition lying in a bin that overlaps
+       *  the circle of the given radius around (eta, phi). Phi wrap-around is taken into account. The result is
+       *  a superset of the objects within the radius: callers must still apply their own deltaR test.
+       */
+      void query(float eta, float phi, float radius, unsigned int partition, std::vector<unsigned int>& candidates) const;
+
+      unsigned int nPartitions() const {return m_nPartitions;}
+      std::size_t size() const {return m_items.size();}
+
+    private:
+      int etaBin(float eta) const;
+      int phiBin(float phi) const;
+
+      float m_binSize;
+      float m_etaMax;
+      unsigned int m_nPartitions;
+      int m_nEtaBins;
+      int m_nPhiBins;
+      float m_phiBinSize;
+
+      //Compressed storage: the objects of bin b are m_items[m_binStart[b]] ... m_items[m_binStart[b+1]-1]
+      std::vector<unsigned int> m_binStart;
+      std::vector<unsigned int> m_items;
+  };
+
+} // Derivation Framework
+#endif
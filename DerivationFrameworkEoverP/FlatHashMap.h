@@ -0,0 +1,101 @@
+/*
+ * @file     FlatHashMap.h
+ * @brief    Minimal open-addressing hash map with linear probing, for per-event lookup tables.
+ *           Keys and values are stored in flat arrays, and the table is cleared without freeing its memory,
+ *           so that it can be refilled every event without allocations.
+ */
+#ifndef DERIVATIONFRAMEWORK_FLATHASHMAP_H
+#define DERIVATIONFRAMEWORK_FLATHASHMAP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DerivationFramework {
+
+  /** 64-bit mix (splitmix64 finaliser), the default hash of FlatHashMap. The slot of a key is taken from the low bits of
+   *  its hash, and std::hash of an integer is the identity in libstdc++: clustered keys (cell identifiers differing in
+   *  their high bits, runs of barcodes, packed indices) would then fill contiguous runs of slots and make every probe a long scan.
+   */
+  struct Mixed64Hash {
+    std::size_t operator()(std::uint64_t h) const {
+      h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+      return h ^ (h >> 31);
+    }
+  };
+
+  /** Key must be an integer type or come with its own Hash */
+  template <typename Key, typename Value, typename Hash = Mixed64Hash>
+  class FlatHashMap {
+    public:
+      typedef Hash hasher;
+
+      FlatHashMap() {rehash(16);}
+
+      /** Remove every entry, keeping the capacity */
+      void clear() {
+        std::fill(m_used.begin(), m_used.end(), 0);
+        m_size = 0;
+      }
+
+      /** Make room for n entries without rehashing */
+      void reserve(std::size_t n) {
+        if (2 * n > m_used.size()) rehash(2 * n);
+      }
+
+      /** Value for the key, default constructed if the key is new */
+      Value& operator[](const Key& key) {
+        if (2 * (m_size + 1) > m_used.size()) rehash(2 * (m_size + 1));
+        std::size_t slot = findSlot(key);
+        if (!m_used[slot]) {
+          m_used[slot] = 1;
+          m_keys[slot] = key;
+          m_values[slot] = Value();
+          m_size++;
+        }
+        return m_values[slot];
+      }
+
+      /** Value for the key, or nullptr if the key is not in the map */
+      const Value* find(const Key& key) const {
+        std::size_t slot = findSlot(key);
+        return m_used[slot] ? &m_values[slot] : nullptr;
+      }
+
+      std::size_t size() const {return m_size;}
+
+    private:
+      //Slot holding the key, or the empty slot where it would be inserted. The table is never full.
+      std::size_t findSlot(const Key& key) const {
+        std::size_t slot = Hash()(key) & m_mask;
+        while (m_used[slot] && !(m_keys[slot] == key)) slot = (slot + 1) & m_mask;
+        return slot;
+      }
+
+      void rehash(std::size_t minCapacity) {
+        std::size_t capacity = 16;
+        while (capacity < minCapacity) capacity *= 2;
+        std::vector<Key> keys(capacity);
+        std::vector<Value> values(capacity);
+        std::vector<unsigned char> used(capacity, 0);
+        keys.swap(m_keys);
+        values.swap(m_values);
+        used.swap(m_used);
+        m_mask = capacity - 1;
+        m_size = 0;
+        for (std::size_t i = 0; i < used.size(); i++) {
+          if (used[i]) (*this)[keys[i]] = values[i];
+        }
+      }
+
+      std::vector<Key> m_keys;
+      std::vector<Value> m_values;
+      std::vector<unsigned char> m_used;
+      std::size_t m_mask = 0;
+      std::size_t m_size = 0;
+  };
+
+} // Derivation Framework
+#endif
@@ -0,0 +1,114 @@
+/*
+ * @file     HelixCaloExtrapolator.h
+ * @brief    Fast parametric track-to-calorimeter extrapolation: a helix in a uniform solenoid field up to the solenoid,
+ *           then a straight line to a nominal cylinder (barrel) or plane (endcap) per sampling. A per-sampling, per-|eta| bin
+ *           correction table, accumulated from the residuals to the full extrapolation, absorbs the material, field map and
+ *           geometry effects that the model leaves out.
+ */
+#ifndef DERIVATIONFRAMEWORK_HELIXCALOEXTRAPOLATOR_H
+#define DERIVATIONFRAMEWORK_HELIXCALOEXTRAPOLATOR_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace DerivationFramework {
+
+  class HelixCaloExtrapolator {
+    public:
+      /** Perigee of the track: point of closest approach (mm), direction at that point and q/p (1/MeV) */
+      struct Track {
+        float x = 0.0;
+        float y = 0.0;
+        float z = 0.0;
+        float phi0 = 0.0;
+        float theta = 0.0;
+        float qOverP = 0.0;
+      };
+
+      /** Track at its exit from the solenoid, from where it is propagated in straight lines */
+      struct State {
+        bool valid = false;
+        float x = 0.0;
+        float y = 0.0;
+        float z = 0.0;
+        float phi = 0.0;
+        float cotTheta = 0.0;
+        float chargeOverPt = 0.0; //1/GeV, the variable of the phi correction
+      };
+
+      /** Width in |eta| of the bins of the correction table */
+      static constexpr float etaBinWidth = 0.1;
+      static constexpr unsigned int nEtaBins = 50;
+
+      /** field: solenoid field (T). The field is taken as uniform inside the solenoid cylinder and zero outside of it (mm). */
+      HelixCaloExtrapolator(unsigned int nSamplings, float field = 2.0, float solenoidRadius = 1150.0, float solenoidHalfLength = 2650.0);
+
+      /** Describe a sampling by a cylinder of the given radius, or by the planes at +-absZ, covering absEtaMin <= |eta| < absEtaMax.
+       *  Samplings without a surface are never reached.
+       */
+      void setBarrelSurface(unsigned int sampling, float radius, float absEtaMin, float absEtaMax);
+      void setEndcapSurface(unsigned int sampling, float absZ, float absEtaMin, float absEtaMax);
+
+      /** Propagate the track along the helix to the boundary of the solenoid */
+      State exitSolenoid(const Track& track) const;
+
+      /** Position of the track on the surface of the sampling. Returns false if the track does not reach it within its eta range. */
+      bool intersect(const State& state, unsigned int sampling, bool applyCorrection, float& eta, float& phi) const;
+
+      /** Text file of the correction table, as written by Residuals::writeCorrections */
+      bool readCorrections(const std::string& fileName);
+
+      unsigned int nSamplings() const {return m_nSamplings;}
+
+      /** Residuals of the full extrapolation to the uncorrected helix one, from which a correction table is derived.
+       *  They are kept apart from the extrapolator, whose correction table does not change once read.
+       */
+      class Residuals {
+        public:
+          Residuals(unsigned int nSamplings);
+
+          /** Accumulate the residual of the full extrapolation (fullEta, fullPhi) to the uncorrected helix one (helixEta, helixPhi) */
+          void add(unsigned int sampling, float helixEta, float helixPhi, float chargeOverPt, float fullEta, float fullPhi);
+
+          /** Text file of the correction table, one line per (sampling, |eta| bin) with residuals. Bins without residuals are not corrected. */
+          bool writeCorrections(const std::string& fileName) const;
+
+        private:
+          struct Sums {
+            double n = 0.0;
+            double deltaEta = 0.0;
+            double xDeltaPhi = 0.0;
+            double xx = 0.0;
+          };
+
+          unsigned int m_nSamplings;
+          std::vector<Sums> m_sums;
+      };
+
+    private:
+      enum SurfaceType {None = 0, Barrel, Endcap};
+      struct Surface {
+        SurfaceType type = None;
+        float position = 0.0;
+        float absEtaMin = 0.0;
+        float absEtaMax = 0.0;
+      };
+      //Correction of a bin: eta += sign(eta) * deltaEta, phi += deltaPhiSlope * q/pT
+      struct Correction {
+        float deltaEta = 0.0;
+        float deltaPhiSlope = 0.0;
+      };
+
+      static std::size_t bin(unsigned int sampling, float eta);
+
+      unsigned int m_nSamplings;
+      float m_field;
+      float m_solenoidRadius;
+      float m_solenoidHalfLength;
+      std::vector<Surface> m_surfaces;
+      std::vector<Correction> m_corrections;
+  };
+
+} // Derivation Framework
+#endif
@@ -0,0 +1,68 @@
+/*
+ * @file     PdgCategory.h
+ * @brief    Compile-time classification of truth particles into a small set of particle classes, by pdgId.
+ *           A background category of calibration hits is a bit mask over these classes.
+ */
+#ifndef DERIVATIONFRAMEWORK_PDGCATEGORY_H
+#define DERIVATIONFRAMEWORK_PDGCATEGORY_H
+
+#include <cstdint>
+#include <string>
+
+namespace DerivationFramework {
+
+  namespace PdgCategory {
+
+    enum Class : unsigned int {
+      Unknown = 0,          //no truth particle for the barcode
+      Photon,
+      Electron,
+      Muon,
+      ChargedPion,
+      ChargedKaon,
+      Proton,
+      Neutron,
+      Neutrino,
+      NuclearFragment,      //ions, |pdgId| >= 1000000000
+      Other,
+      nClasses
+    };
+
+    /** Mask of all of the classes */
+    constexpr std::uint32_t all = (1u << nClasses) - 1;
+
+    constexpr std::uint32_t bit(Class particleClass) {return 1u << particleClass;}
+
+    /** Class of a pdgId. pdgId 0 is used for particles that could not be found. */
+    constexpr Class classify(int pdgId) {
+      int absPdgId = pdgId < 0 ? -pdgId : pdgId;
+      if (absPdgId >= 1000000000) return NuclearFragment;
+      switch (absPdgId) {
+        case 0: return Unknown;
+        case 22: return Photon;
+        case 11: return Electron;
+        case 13: return Muon;
+        case 211: return ChargedPion;
+        case 321: return ChargedKaon;
+        case 2212: return Proton;
+        case 2112: return Neutron;
+        case 12: case 14: case 16: return Neutrino;
+        default: return Other;
+      }
+    }
+
+    /** Mask of a class name ("Photon", "Neutron", ...), or of "Any" for every class. Returns false for an unknown name. */
+    inline bool maskFromName(const std::string& name, std::uint32_t& mask) {
+      static const char* const names[nClasses] = {"Unknown", "Photon", "Electron", "Muon", "ChargedPion", "ChargedKaon",
+                                                  "Proton", "Neutron", "Neutrino", "NuclearFragment", "Other"};
+      if (name == "Any") {mask = all; return true;}
+      for (unsigned int i = 0; i < nClasses; i++) {
+        if (name == names[i]) {mask = 1u << i; return true;}
+      }
+      return false;
+    }
+
+  } // PdgCategory
+
+} // Derivation Framework
+#endif
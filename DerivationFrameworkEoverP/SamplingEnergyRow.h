@@ -0,0 +1,34 @@
+/*
+ * @file     SamplingEnergyRow.h
+ * @brief    Fixed-width row of per-sampling energies. Every calorimeter sampling has a lane, and the row is padded
+ *           to a multiple of the vector width, so that summing rows compiles to a few vector adds without a remainder loop.
+ */
+#ifndef DERIVATIONFRAMEWORK_SAMPLINGENERGYROW_H
+#define DERIVATIONFRAMEWORK_SAMPLINGENERGYROW_H
+
+namespace DerivationFramework {
+
+  namespace SamplingEnergyRow {
+
+    /** Number of lanes in a row. Must be at least the number of calorimeter samplings. */
+    constexpr unsigned int width = 32;
+
+    /** A row as a value type, aligned to the 256-bit vector width */
+    struct alignas(32) Row {
+      float lane[width];
+    };
+
+    /** sum[lane] += row[lane] for every lane */
+    inline void add(float* __restrict sum, const float* __restrict row) {
+      for (unsigned int lane = 0; lane < width; lane++) sum[lane] += row[lane];
+    }
+
+    /** sum[lane] += weight * row[lane] for every lane */
+    inline void addScaled(float* __restrict sum, const float* __restrict row, float weight) {
+      for (unsigned int lane = 0; lane < width; lane++) sum[lane] += weight * row[lane];
+    }
+
+  } // SamplingEnergyRow
+
+} // Derivation Framework
+#endif
@@ -12,10 +12,16 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
 #include "TH1F.h"
+#include "TH2F.h"
 #include "TTree.h"
 
+#include "tbb/task_arena.h"
+
 #include "AthenaBaseComps/AthAlgTool.h"
 #include "MCTruthClassifier/IMCTruthClassifier.h"
 #include "DerivationFrameworkInterfaces/IAugmentationTool.h"
@@ -24,15 +30,34 @@
 #include "GaudiKernel/ITHistSvc.h"
 #include "CaloIdentifier/CaloCell_ID.h"
 #include "RecoToolInterfaces/IParticleCaloExtensionTool.h"
+#include "TrkCaloExtension/CaloExtensionCollection.h"
 #include "xAODCaloEvent/CaloClusterContainer.h"
 #include "xAODCaloEvent/CaloClusterChangeSignalState.h"
 #include "CaloEvent/CaloClusterContainer.h"
 #include "CaloEvent/CaloCluster.h"
 #include "CaloEvent/CaloCellContainer.h"
 #include "xAODTruth/TruthParticleContainer.h"
+#include "xAODTracking/TrackParticle.h"
+#include "xAODTracking/Vertex.h"
 #include "CaloSimEvent/CaloCalibrationHitContainer.h"  
+#include "CaloDetDescr/CaloDetDescrManager.h"
+#include "CaloConditions/CaloNoise.h"
+#include "StoreGate/ReadCondHandleKey.h"
+#include "DerivationFrameworkEoverP/HelixCaloExtrapolator.h"
 
 class TileTBID;
+class CaloDM_ID;
+class CaloDmDescrManager;
+
+namespace DerivationFramework {
+  struct CaloClusterSnapshot;
+  class CaloCellGeometryTable;
+  class CalibrationHitIndex;
+  class TruthBarcodeTable;
+  class ClusterCellTable;
+  class CalibrationHitBreakdown;
+  struct TrackImpactTable;
+}
 
 namespace Trk {
   class IExtrapolator;
@@ -46,32 +71,19 @@ namespace DerivationFramework {
       TrackCaloDecorator(const std::string& t, const std::string& n, const IInterface* p);
 
      std::vector<std::string> m_cutNames;
-     const std::map<std::string, float> m_stringToCut = {
-     {"025" , 0.025},
-     {"050" , 0.050},
-     {"075" , 0.075},
-     {"100" , 0.100},
-     {"125" , 0.125},
-     {"150" , 0.150},
-     {"175" , 0.175},
-     {"125" , 0.125},
-     {"150" , 0.150},
-     {"175" , 0.175},
-     {"200" , 0.200},
-     {"225" , 0.225},
-     {"250" , 0.250},
-     {"275" , 0.275},
-     {"300" , 0.300}
-     };
-
-     const unsigned int m_ncuts = m_stringToCut.size();
+     unsigned int m_ncuts = 0;
      const unsigned int m_nsamplings = CaloSampling::getNumberOfSamplings();
 
      std::vector<CaloSampling::CaloSample> m_caloSamplingNumbers;
      std::vector<unsigned int> m_caloSamplingIndices;
-     std::map<CaloSampling::CaloSample, unsigned int> m_mapCaloSamplingToIndex;
+     //Whether each sampling number is in m_caloSamplingNumbers
+     std::vector<bool> m_samplingIsDecorated;
 
       std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_CellEnergy;
+      //Only filled in the TopoCells and Both CellConeMode
+      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_TopoCellEnergy;
+      //Only filled when the CellNoiseSignificanceCut is enabled
+      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_SignificantCellEnergy;
       std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterEnergy;
       std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_LCWClusterEnergy;
 
@@ -85,28 +97,19 @@ namespace DerivationFramework {
       std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterInvisibleInactiveCalibHitEnergy;
       std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterEscapedInactiveCalibHitEnergy;
 
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEMActiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundNonEMActiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundInvisibleActiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEscapedActiveCalibHitEnergy;
-
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEMInactiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundNonEMInactiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundInvisibleInactiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEscapedInactiveCalibHitEnergy;
+      //Dead-material calibration hit energies around the track, indexed by cut: from the matched particle and from all particles
+      std::vector<SG::AuxElement::Decorator< float > > m_cutToDecorator_DeadMaterialCalibHitEnergy;
+      std::vector<SG::AuxElement::Decorator< float > > m_cutToDecorator_AllDeadMaterialCalibHitEnergy;
 
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEMActiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundNonEMActiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundInvisibleActiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEscapedActiveCalibHitEnergy;
-
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEMInactiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundNonEMInactiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundInvisibleInactiveCalibHitEnergy;
-      std::vector< std::vector<SG::AuxElement::Decorator< float > > > m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEscapedInactiveCalibHitEnergy;
+      //Background calibration hit energies, indexed by [background category][hit kind * 4 + energy type][cut][sampling index]
+      std::vector< std::vector< std::vector< std::vector<SG::AuxElement::Decorator< float > > > > > m_categoryToHitTypeToCutToCaloSamplingIndexToDecorator_ClusterBackgroundCalibHitEnergy;
 
       std::vector<SG::AuxElement::Decorator< float > >  m_caloSamplingIndexToDecorator_extrapolTrackEta;
       std::vector<SG::AuxElement::Decorator< float > >  m_caloSamplingIndexToDecorator_extrapolTrackPhi;
+      //Exit point from each layer, and path length in it between the entry and the exit
+      std::vector<SG::AuxElement::Decorator< float > >  m_caloSamplingIndexToDecorator_extrapolTrackExitEta;
+      std::vector<SG::AuxElement::Decorator< float > >  m_caloSamplingIndexToDecorator_extrapolTrackExitPhi;
+      std::vector<SG::AuxElement::Decorator< float > >  m_caloSamplingIndexToDecorator_extrapolTrackPathLength;
 
       StatusCode initialize();
       StatusCode finalize();
@@ -117,11 +120,79 @@ namespace DerivationFramework {
       std::vector<unsigned int> m_cutNumbers;
       std::map<unsigned int, float> m_cutNumberToCut;
       std::map<unsigned int, std::string> m_cutNumberToCutName;
+      //Squared cone sizes, indexed by cut number, in increasing order
+      std::vector<float> m_coneSizeSquared;
+      //Attribution categories of the calibration hits: the signal particle, then the background categories in order
+      static constexpr unsigned int s_signalHits = 0;
+      static constexpr unsigned int s_unassignedHits = ~0u;
+      //Background categories (BackgroundCategories property), as "Name:Class+Class+...", with the PdgCategory class names or "Any".
+      //A hit goes to the first category containing the class of its particle, and is not summed if there is none.
+      std::vector<std::string> m_backgroundCategories;
+      std::vector<std::string> m_backgroundCategoryNames;
+      //Hit category of each PdgCategory class
+      std::vector<unsigned int> m_pdgClassToHitCategory;
+      unsigned int m_nHitCategories = 1;
+      //No intersection of the track with a layer in the CaloIntersectionBuffer
+      static constexpr std::size_t s_noRecord = ~std::size_t(0);
+      //Clusters within this dR of the track are stored in the vector-like cluster decorations
+      static constexpr float s_clusterDecorationDeltaR = 0.3;
       std::string m_sgName;
       std::string m_eventInfoContainerName;
       std::string m_trackContainerName;
       std::string m_caloClusterContainerName;
 
+      //Bin size of the per-event eta-phi grid of clusters used for track-cluster matching
+      float m_clusterGridBinSize;
+      //Bin size of the per-sampling eta-phi grids of the cell geometry table
+      float m_cellGridBinSize;
+      //Which cells are summed in the cones: "AllCells" (every cell of the container), "TopoCells" (the cells of the matched clusters) or "Both"
+      std::string m_cellConeMode;
+      bool m_doAllCellCones = true;
+      bool m_doTopoCellCones = false;
+      //Cells with |E| > m_cellSignificanceCut * sigma_noise are also summed in the _SignificantCellEnergy_ decorations. Disabled if negative.
+      float m_cellSignificanceCut;
+      //Largest dR at which a cluster or a cell can be matched to a track
+      float m_clusterMatchRadius;
+      //Cone sizes (ConeSizes property) and the names of the decorated samplings (CaloSamplings property, empty for all)
+      std::vector<float> m_coneSizes;
+      std::vector<std::string> m_samplingNames;
+
+      //Track preselection, applied before the calorimeter extension. Negative values disable a requirement.
+      float m_trackMinPt; //MeV
+      float m_trackMaxAbsEta;
+      int m_trackMinPixelHits;
+      int m_trackMinSiHits;
+      float m_trackMaxZ0SinTheta; //mm, with respect to the PriVtx entry of PrimaryVertices
+
+      //Track extrapolation to the calorimeter: "Full" (TheTrackExtrapolatorTool), "Helix" (HelixCaloExtrapolator)
+      //or "Rematch" (the impact points stored on the tracks by a previous run with WriteImpactPoints)
+      std::string m_extrapolationMode;
+      bool m_useFullExtrapolation = true;
+      bool m_useHelixExtrapolation = false;
+      bool m_useStoredImpactPoints = false;
+      //Decorate the tracks with their impact points in all of the samplings (_impactSampling, _impactEta, _impactPhi)
+      bool m_writeImpactPoints;
+      //Decoration prefix of the impact points read in the Rematch mode, DecorationPrefix if empty
+      std::string m_impactPointPrefix;
+      //Full mode without InputCaloExtension: extend the tracks of an event concurrently, on ExtensionThreads threads (0 for the TBB default)
+      bool m_parallelExtension;
+      int m_extensionThreads;
+      std::unique_ptr<tbb::task_arena> m_extensionArena;
+      float m_solenoidField; //T
+      //Correction table of the helix extrapolation to read, and, in the Full mode, to write at finalize from the residuals of the job
+      std::string m_helixCorrectionFile;
+      std::string m_helixCorrectionOutputFile;
+      //Fraction of the extrapolated tracks whose full and corrected helix positions are compared in the residual histograms (Full mode)
+      float m_helixValidationFraction;
+      std::string m_helixValidationHistPath;
+      //The extrapolator and its correction table are fixed in initialize, the residuals of the job are accumulated under m_helixMutex
+      std::unique_ptr<const HelixCaloExtrapolator> m_helixExtrapolator;
+      mutable std::unique_ptr<HelixCaloExtrapolator::Residuals> m_helixResiduals;
+      mutable std::mutex m_helixMutex;
+      mutable std::atomic<unsigned long> m_helixValidationCount{0};
+      TH2F* m_helixResidualEta = nullptr;
+      TH2F* m_helixResidualPhi = nullptr;
+
 
       std::string m_tileActiveHitCnt;
       std::string m_tileInactiveHitCnt;
@@ -137,9 +208,15 @@ namespace DerivationFramework {
       Trk::TrackParametersIdHelper* m_trackParametersIdHelper;
 
       const TileTBID* m_tileTBID; 
+      //Identifier helper and region descriptions of the dead-material calibration hits
+      const CaloDM_ID* m_caloDmID = nullptr;
+      const CaloDmDescrManager* m_caloDmDescrManager = nullptr;
 
       bool m_doCutflow;
 
+      //Clusters of the job with at least one of the snapshot moments missing, reported at finalize
+      mutable std::atomic<unsigned long> m_clustersWithoutMoments{0};
+
       // Tree with run number, event number, lumi block, and nTrks
       TTree* m_tree;
       int m_runNumber;
@@ -182,10 +259,44 @@ namespace DerivationFramework {
       };
 
 
-    public: 
-      void getHitsSum(const CaloCalibrationHitContainer* hits,const  xAOD::CaloCluster* cl,  unsigned int particle_barcode, std::vector< std::vector<float> >& hitsMap) const;
+      /** ReadHandleKey for a CaloExtensionCollection of the track container, made upstream.
+       *  If empty, the preselected tracks are extended once per event by TheTrackExtrapolatorTool.
+       */
+      SG::ReadHandleKey<CaloExtensionCollection> m_caloExtensionKey{
+          this,
+              "InputCaloExtension",
+              "",
+              "ReadHandleKey for the CaloExtensionCollection of the track container"
+      };
+
+      /** ReadCondHandleKey for the calorimeter geometry, from which the cell geometry table is built */
+      SG::ReadCondHandleKey<CaloDetDescrManager> m_caloDetDescrMgrKey{
+          this,
+              "CaloDetDescrManager",
+              "CaloDetDescrManager",
+              "SG key of the CaloDetDescrManager conditions object"
+      };
+
+      /** ReadCondHandleKey for the cell noise, used for the cell significance */
+      SG::ReadCondHandleKey<CaloNoise> m_caloNoiseKey{
+          this,
+              "CaloNoiseKey",
+              "totalNoise",
+              "SG key of the CaloNoise conditions object"
+      };
+
+      //Cell geometry table, built on first use and rebuilt whenever the geometry conditions object changes
+      mutable std::mutex m_cellGeometryMutex;
+      mutable std::shared_ptr<const CaloCellGeometryTable> m_cellGeometry;
+      mutable const CaloDetDescrManager* m_cellGeometryManager = nullptr;
+
+      std::shared_ptr<const CaloCellGeometryTable> cellGeometryTable(const CaloDetDescrManager* caloMgr) const;
+      void fillHelixImpacts(const xAOD::TrackParticle* track, std::size_t trackIndex, bool applyCorrection, TrackImpactTable& impactTable) const;
+      void setNominalSamplingSurfaces(HelixCaloExtrapolator& helix) const;
+      bool passesPreselection(const xAOD::TrackParticle* track, const xAOD::Vertex* primaryVertex) const;
+      void fillClusterSnapshot(const xAOD::CaloClusterContainer* clusters, CaloClusterSnapshot& snapshot) const;
 
-      void getHitsSumAllBackground(const CaloCalibrationHitContainer* hits, const xAOD::CaloCluster* cl,  unsigned int particle_barcode, const xAOD::TruthParticleContainer* truthParticles, std::vector<int> sumForThesePDGIDs, std::vector<int> skipThesePDGIDs,  std::vector< std::vector<float> >& hitsMap) const;
+      void sumClusterHits(const CalibrationHitIndex& hits, unsigned int hitKind, const ClusterCellTable& clusterCells, unsigned int clusterIndex, unsigned int particle_barcode, const TruthBarcodeTable& truthBarcodes, CalibrationHitBreakdown& breakdown) const;
   }; 
 } // Derivation Framework
 #endif 
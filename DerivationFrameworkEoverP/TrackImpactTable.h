@@ -0,0 +1,46 @@
+/*
+ * @file     TrackImpactTable.h
+ * @brief    Dense (track x sampling) table of the extrapolated track positions in the calorimeter.
+ *           Filled from the calo extension of each track, and read by the matching steps and the _trkEta_/_trkPhi_ decorations.
+ */
+#ifndef DERIVATIONFRAMEWORK_TRACKIMPACTTABLE_H
+#define DERIVATIONFRAMEWORK_TRACKIMPACTTABLE_H
+
+#include <cstddef>
+#include <vector>
+
+namespace DerivationFramework {
+
+  struct TrackImpactTable {
+
+    void resize(std::size_t nTracks, unsigned int nSamplings) {
+      tracks = nTracks;
+      samplings = nSamplings;
+      eta.assign(nTracks * nSamplings, 0.0);
+      phi.assign(nTracks * nSamplings, 0.0);
+      valid.assign(nTracks * nSamplings, 0);
+    }
+
+    std::size_t index(std::size_t track, unsigned int sampling) const {return track * samplings + sampling;}
+
+    bool isValid(std::size_t track, unsigned int sampling) const {return sampling < samplings && valid[index(track, sampling)];}
+    float etaAt(std::size_t track, unsigned int sampling) const {return eta[index(track, sampling)];}
+    float phiAt(std::size_t track, unsigned int sampling) const {return phi[index(track, sampling)];}
+
+    void set(std::size_t track, unsigned int sampling, float trackEta, float trackPhi) {
+      std::size_t i = index(track, sampling);
+      eta[i] = trackEta;
+      phi[i] = trackPhi;
+      valid[i] = 1;
+    }
+
+    std::size_t tracks = 0;
+    unsigned int samplings = 0;
+
+    std::vector<float> eta;
+    std::vector<float> phi;
+    std::vector<unsigned char> valid;
+  };
+
+} // Derivation Framework
+#endif
@@ -0,0 +1,54 @@
+/*
+ * @file     TruthBarcodeTable.h
+ * @brief    Per-event lookup of truth particles by barcode, giving the pdgId, its PdgCategory class and the index in the
+ *           TruthParticles container.
+ *           Used to attribute the calibration hits of background particles without scanning the truth container.
+ */
+#ifndef DERIVATIONFRAMEWORK_TRUTHBARCODETABLE_H
+#define DERIVATIONFRAMEWORK_TRUTHBARCODETABLE_H
+
+#include "DerivationFrameworkEoverP/FlatHashMap.h"
+#include "DerivationFrameworkEoverP/PdgCategory.h"
+#include "xAODTruth/TruthParticleContainer.h"
+
+#include <cstddef>
+
+namespace DerivationFramework {
+
+  class TruthBarcodeTable {
+    public:
+      struct Entry {
+        int pdgId = 0;
+        PdgCategory::Class pdgClass = PdgCategory::Unknown;
+        unsigned int index = 0;
+      };
+
+      /** Index the truth particles. If several particles share a barcode, the first one in the container is kept.
+       *  A null container gives an empty table.
+       */
+      void build(const xAOD::TruthParticleContainer* truthParticles);
+
+      /** Truth particle with the barcode, or nullptr if there is none */
+      const Entry* find(unsigned int barcode) const {return m_entries.find(barcode);}
+
+      /** pdgId of the truth particle with the barcode, 0 if there is none */
+      int pdgId(unsigned int barcode) const {
+        const Entry* entry = find(barcode);
+        return entry ? entry->pdgId : 0;
+      }
+
+      /** Particle class of the truth particle with the barcode, Unknown if there is none */
+      PdgCategory::Class pdgClass(unsigned int barcode) const {
+        const Entry* entry = find(barcode);
+        return entry ? entry->pdgClass : PdgCategory::Unknown;
+      }
+
+      std::size_t size() const {return m_entries.size();}
+
+    private:
+      //the primary (1, 2, ...) and secondary (200001, ...) barcodes are dense runs, which the mixed hash spreads over the table
+      FlatHashMap<unsigned int, Entry, Mixed64Hash> m_entries;
+  };
+
+} // Derivation Framework
+#endif
@@ -0,0 +1,47 @@
+#include "DerivationFrameworkEoverP/CalibrationHitIndex.h"
+#include "CaloSimEvent/CaloCalibrationHitContainer.h"
+
+#include <algorithm>
+
+namespace DerivationFramework {
+
+  void CalibrationHitIndex::build(const CaloCalibrationHitContainer* hits) {
+    m_energies.clear();
+    m_cellIndex.clear();
+    m_cellStart.clear();
+    m_cellHitBarcode.clear();
+    m_cellHitEnergies.clear();
+    if (!hits) return;
+
+    //Keys in order of first appearance, to lay out the summed hits by cell afterwards
+    std::vector<CalibrationHitKey> keys;
+    keys.reserve(hits->size());
+    m_energies.reserve(hits->size());
+    for (const CaloCalibrationHit* hit : *hits) {
+      CalibrationHitKey key;
+      key.cellID = hit->cellID().get_compact();
+      key.barcode = hit->particleID();
+      if (!m_energies.find(key)) keys.push_back(key);
+      CalibrationHitEnergies& energies = m_energies[key];
+      energies.energy[0] += hit->energyEM();
+      energies.energy[1] += hit->energyNonEM();
+      energies.energy[2] += hit->energyInvisible();
+      energies.energy[3] += hit->energyEscaped();
+    }
+
+    std::stable_sort(keys.begin(), keys.end(), [](const CalibrationHitKey& a, const CalibrationHitKey& b) {return a.cellID < b.cellID;});
+    m_cellHitBarcode.reserve(keys.size());
+    m_cellHitEnergies.reserve(keys.size());
+    m_cellIndex.reserve(keys.size());
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      if (i == 0 || keys[i].cellID != keys[i-1].cellID) {
+        m_cellIndex[keys[i].cellID] = m_cellStart.size();
+        m_cellStart.push_back(i);
+      }
+      m_cellHitBarcode.push_back(keys[i].barcode);
+      m_cellHitEnergies.push_back(*m_energies.find(keys[i]));
+    }
+    m_cellStart.push_back(keys.size());
+  }
+
+} // Derivation Framework
@@ -0,0 +1,39 @@
+#include "DerivationFrameworkEoverP/CaloCellGeometryTable.h"
+#include "CaloDetDescr/CaloDetDescrManager.h"
+#include "CaloDetDescr/CaloDetDescrElement.h"
+#include "Identifier/IdentifierHash.h"
+
+namespace DerivationFramework {
+
+  CaloCellGeometryTable::CaloCellGeometryTable(float binSize, unsigned int nSamplings) :
+    m_nSamplings(nSamplings),
+    m_grid(binSize, 5.0, nSamplings){
+    }
+
+  void CaloCellGeometryTable::build(const CaloDetDescrManager& caloMgr) {
+    std::size_t nHashes = caloMgr.element_size();
+    std::vector<float> eta(nHashes, -999);
+    std::vector<float> phi(nHashes, -999);
+    std::vector<unsigned int> sampling(nHashes, m_nSamplings);
+    for (std::size_t hash = 0; hash < nHashes; hash++) {
+      const CaloDetDescrElement* dde = caloMgr.get_element(IdentifierHash(hash));
+      if (!dde) continue;
+      if (dde->eta() == -999 || dde->phi() == -999) continue;
+      eta[hash] = dde->eta();
+      phi[hash] = dde->phi();
+      sampling[hash] = dde->getSampling();
+    }
+    build(nHashes, eta.data(), phi.data(), sampling.data());
+  }
+
+  void CaloCellGeometryTable::build(std::size_t nHashes, const float* eta, const float* phi, const unsigned int* sampling) {
+    m_eta.assign(eta, eta + nHashes);
+    m_phi.assign(phi, phi + nHashes);
+    m_sampling.assign(sampling, sampling + nHashes);
+    for (unsigned int& s : m_sampling) {
+      if (s > m_nSamplings) s = m_nSamplings;
+    }
+    m_grid.build(nHashes, m_eta.data(), m_phi.data(), m_sampling.data());
+  }
+
+} // Derivation Framework
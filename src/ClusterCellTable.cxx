@@ -0,0 +1,38 @@
+#include "DerivationFrameworkEoverP/ClusterCellTable.h"
+#include "CaloEvent/CaloClusterCellLink.h"
+#include "CaloEvent/CaloCell.h"
+
+#include <algorithm>
+
+namespace DerivationFramework {
+
+  void ClusterCellTable::reset(std::size_t nClusters) {
+    m_first.assign(nClusters, s_notFilled);
+    m_count.assign(nClusters, 0);
+    m_members.clear();
+  }
+
+  void ClusterCellTable::fill(std::size_t clusterIndex, const xAOD::CaloCluster* cluster) {
+    if (isFilled(clusterIndex)) return;
+    m_first[clusterIndex] = m_members.size();
+    const CaloClusterCellLink* cellLinks = cluster->getCellLinks();
+    if (cellLinks) {
+      for (const CaloCell* cell : *cellLinks) {
+        Member member;
+        member.cellID = cell->ID().get_compact();
+        member.sampling = cell->caloDDE()->getSampling();
+        m_members.push_back(member);
+      }
+    }
+    m_count[clusterIndex] = m_members.size() - m_first[clusterIndex];
+    std::sort(m_members.begin() + m_first[clusterIndex], m_members.end(), [](const Member& a, const Member& b) {return a.cellID < b.cellID;});
+  }
+
+  bool ClusterCellTable::contains(std::size_t clusterIndex, std::uint64_t cellID) const {
+    const Member* first = begin(clusterIndex);
+    const Member* last = end(clusterIndex);
+    const Member* it = std::lower_bound(first, last, cellID, [](const Member& member, std::uint64_t id) {return member.cellID < id;});
+    return it != last && it->cellID == cellID;
+  }
+
+} // Derivation Framework
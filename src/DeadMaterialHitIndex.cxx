@@ -0,0 +1,44 @@
+#include "DerivationFrameworkEoverP/DeadMaterialHitIndex.h"
+#include "CaloSimEvent/CaloCalibrationHitContainer.h"
+#include "CaloIdentifier/CaloDM_ID.h"
+#include "CaloDmDetDescr/CaloDmDescrManager.h"
+#include "CaloDmDetDescr/CaloDmRegion.h"
+
+#include <cmath>
+
+namespace DerivationFramework {
+
+  DeadMaterialHitIndex::DeadMaterialHitIndex(float binSize) :
+    m_grid(binSize, 5.0, 1)
+  {}
+
+  void DeadMaterialHitIndex::clear() {
+    m_eta.clear();
+    m_phi.clear();
+    m_energy.clear();
+    m_barcode.clear();
+  }
+
+  void DeadMaterialHitIndex::add(const CaloCalibrationHitContainer* hits, const CaloDM_ID& dmID, const CaloDmDescrManager& dmManager) {
+    if (!hits) return;
+    for (const CaloCalibrationHit* hit : *hits) {
+      Identifier id = hit->cellID();
+      const CaloDmRegion* region = dmManager.get_dm_region(id);
+      if (!region) continue;
+      //centre of the (eta, phi) bin of the hit in its region
+      float eta = region->eta_min() + (dmID.eta(id) + 0.5) * region->deta();
+      if (dmID.pos_neg_z(id) < 0) eta = -eta;
+      float phi = (dmID.phi(id) + 0.5) * region->dphi();
+      if (phi > M_PI) phi -= 2 * M_PI;
+      m_eta.push_back(eta);
+      m_phi.push_back(phi);
+      m_energy.push_back(hit->energyTotal());
+      m_barcode.push_back(hit->particleID());
+    }
+  }
+
+  void DeadMaterialHitIndex::build() {
+    m_grid.build(m_energy.size(), m_eta.data(), m_phi.data());
+  }
+
+} // Derivation Framework
@@ -0,0 +1,84 @@
+#include "DerivationFrameworkEoverP/DeltaRKernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define DELTARKERNEL_HAS_AVX2_PATH 1
+#endif
+
+namespace DerivationFramework {
+
+  namespace DeltaRKernel {
+
+    namespace {
+      const float twoPi = 2.0 * M_PI;
+    }
+
+    void coneBinsScalar(const float* eta, const float* phi, std::size_t n, float trackEta, float trackPhi,
+                        const float* coneSizeSquared, unsigned int nCones, int* bins, float* deltaR2) {
+      for (std::size_t i = 0; i < n; i++) {
+        float etaDiff = eta[i] - trackEta;
+        float phiDiff = std::fabs(phi[i] - trackPhi);
+        phiDiff = std::min(phiDiff, twoPi - phiDiff);
+        float dR2 = etaDiff * etaDiff + phiDiff * phiDiff;
+        //The cones are sorted, so the first cone containing the object is the number of cones that do not contain it.
+        //NaN distances are counted as outside every cone.
+        int bin = 0;
+        for (unsigned int cone = 0; cone < nCones; cone++) bin += !(dR2 < coneSizeSquared[cone]);
+        bins[i] = bin;
+        deltaR2[i] = dR2;
+      }
+    }
+
+#ifdef DELTARKERNEL_HAS_AVX2_PATH
+    __attribute__((target("avx2")))
+    void coneBinsAVX2(const float* eta, const float* phi, std::size_t n, float trackEta, float trackPhi,
+                      const float* coneSizeSquared, unsigned int nCones, int* bins, float* deltaR2) {
+      const __m256 vTrackEta = _mm256_set1_ps(trackEta);
+      const __m256 vTrackPhi = _mm256_set1_ps(trackPhi);
+      const __m256 vTwoPi = _mm256_set1_ps(twoPi);
+      const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+      std::size_t i = 0;
+      for (; i + 8 <= n; i += 8) {
+        __m256 etaDiff = _mm256_sub_ps(_mm256_loadu_ps(eta + i), vTrackEta);
+        __m256 phiDiff = _mm256_and_ps(_mm256_sub_ps(_mm256_loadu_ps(phi + i), vTrackPhi), absMask);
+        phiDiff = _mm256_min_ps(phiDiff, _mm256_sub_ps(vTwoPi, phiDiff));
+        __m256 dR2 = _mm256_add_ps(_mm256_mul_ps(etaDiff, etaDiff), _mm256_mul_ps(phiDiff, phiDiff));
+
+        //Comparison masks are all ones (-1) where the object is not inside the cone
+        __m256i bin = _mm256_setzero_si256();
+        for (unsigned int cone = 0; cone < nCones; cone++) {
+          __m256 outside = _mm256_cmp_ps(dR2, _mm256_set1_ps(coneSizeSquared[cone]), _CMP_NLT_UQ);
+          bin = _mm256_sub_epi32(bin, _mm256_castps_si256(outside));
+        }
+        _mm256_storeu_si256((__m256i*)(bins + i), bin);
+        _mm256_storeu_ps(deltaR2 + i, dR2);
+      }
+      coneBinsScalar(eta + i, phi + i, n - i, trackEta, trackPhi, coneSizeSquared, nCones, bins + i, deltaR2 + i);
+    }
+
+    bool hasAVX2() {
+      static const bool avx2 = __builtin_cpu_supports("avx2");
+      return avx2;
+    }
+#else
+    void coneBinsAVX2(const float* eta, const float* phi, std::size_t n, float trackEta, float trackPhi,
+                      const float* coneSizeSquared, unsigned int nCones, int* bins, float* deltaR2) {
+      coneBinsScalar(eta, phi, n, trackEta, trackPhi, coneSizeSquared, nCones, bins, deltaR2);
+    }
+
+    bool hasAVX2() {return false;}
+#endif
+
+    void coneBins(const float* eta, const float* phi, std::size_t n, float trackEta, float trackPhi,
+                  const float* coneSizeSquared, unsigned int nCones, int* bins, float* deltaR2) {
+      if (hasAVX2()) coneBinsAVX2(eta, phi, n, trackEta, trackPhi, coneSizeSquared, nCones, bins, deltaR2);
+      else coneBinsScalar(eta, phi, n, trackEta, trackPhi, coneSizeSquared, nCones, bins, deltaR2);
+    }
+
+  } // DeltaRKernel
+
+} // Derivation Framework
@@ -0,0 +1,81 @@
+#include "DerivationFrameworkEoverP/EtaPhiGridIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace DerivationFramework {
+
+  EtaPhiGridIndex::EtaPhiGridIndex(float binSize, float etaMax, unsigned int nPartitions) :
+    m_binSize(binSize),
+    m_etaMax(etaMax),
+    m_nPartitions(nPartitions){
+      m_nEtaBins = std::max(1, (int)std::ceil(2.0 * etaMax / binSize));
+      //Use an integer number of phi bins so that the first and last bins meet at phi = +-pi
+      m_nPhiBins = std::max(1, (int)std::floor(2.0 * M_PI / binSize));
+      m_phiBinSize = 2.0 * M_PI / m_nPhiBins;
+      m_binStart.assign((std::size_t)m_nPartitions * m_nEtaBins * m_nPhiBins + 1, 0);
+    }
+
+  int EtaPhiGridIndex::etaBin(float eta) const {
+    int bin = (int)std::floor((eta + m_etaMax) / m_binSize);
+    return std::min(std::max(bin, 0), m_nEtaBins - 1);
+  }
+
+  int EtaPhiGridIndex::phiBin(float phi) const {
+    int bin = (int)std::floor((phi + M_PI) / m_phiBinSize);
+    bin %= m_nPhiBins;
+    if (bin < 0) bin += m_nPhiBins;
+    return bin;
+  }
+
+  void EtaPhiGridIndex::build(std::size_t n, const float* eta, const float* phi, const unsigned int* partition) {
+    const std::size_t binsPerPartition = (std::size_t)m_nEtaBins * m_nPhiBins;
+    std::fill(m_binStart.begin(), m_binStart.end(), 0);
+
+    //Counting sort of the objects into their bins. Objects keep their relative order inside a bin.
+    std::vector<unsigned int> objectBin(n);
+    for (std::size_t i = 0; i < n; i++) {
+      unsigned int part = partition ? partition[i] : 0;
+      if (part >= m_nPartitions) {
+        objectBin[i] = m_binStart.size() - 1;
+        continue;
+      }
+      objectBin[i] = part * binsPerPartition + etaBin(eta[i]) * m_nPhiBins + phiBin(phi[i]);
+      m_binStart[objectBin[i] + 1] += 1;
+    }
+    for (std::size_t b = 1; b < m_binStart.size(); b++) m_binStart[b] += m_binStart[b-1];
+
+    m_items.resize(m_binStart.back());
+    std::vector<unsigned int> fill(m_binStart.begin(), m_binStart.end() - 1);
+    for (std::size_t i = 0; i < n; i++) {
+      if (objectBin[i] == m_binStart.size() - 1) continue;
+      m_items[fill[objectBin[i]]++] = i;
+    }
+  }
+
+  void EtaPhiGridIndex::query(float eta, float phi, float radius, unsigned int partition, std::vector<unsigned int>& candidates) const {
+    if (partition >= m_nPartitions) return;
+    const std::size_t partitionOffset = (std::size_t)partition * m_nEtaBins * m_nPhiBins;
+
+    int firstEta = etaBin(eta - radius);
+    int lastEta = etaBin(eta + radius);
+
+    //Phi bins are not clamped but wrapped around; a circle wider than the full range visits every bin once
+    int firstPhi = (int)std::floor((phi - radius + M_PI) / m_phiBinSize);
+    int lastPhi = (int)std::floor((phi + radius + M_PI) / m_phiBinSize);
+    if (lastPhi - firstPhi + 1 >= m_nPhiBins) {
+      firstPhi = 0;
+      lastPhi = m_nPhiBins - 1;
+    }
+
+    for (int ieta = firstEta; ieta <= lastEta; ieta++) {
+      for (int iphi = firstPhi; iphi <= lastPhi; iphi++) {
+        int wrapped = iphi % m_nPhiBins;
+        if (wrapped < 0) wrapped += m_nPhiBins;
+        std::size_t bin = partitionOffset + (std::size_t)ieta * m_nPhiBins + wrapped;
+        candidates.insert(candidates.end(), m_items.begin() + m_binStart[bin], m_items.begin() + m_binStart[bin+1]);
+      }
+    }
+  }
+
+} // Derivation Framework
@@ -0,0 +1,197 @@
+#include "DerivationFrameworkEoverP/HelixCaloExtrapolator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+
+namespace DerivationFramework {
+
+  namespace {
+    //Radius of curvature (mm) per MeV of pT and per tesla
+    const double curvatureConstant = 1.0 / 0.299792458;
+
+    float wrapPhi(float phi) {
+      while (phi > M_PI) phi -= 2 * M_PI;
+      while (phi <= -M_PI) phi += 2 * M_PI;
+      return phi;
+    }
+  }
+
+  HelixCaloExtrapolator::HelixCaloExtrapolator(unsigned int nSamplings, float field, float solenoidRadius, float solenoidHalfLength) :
+    m_nSamplings(nSamplings),
+    m_field(field),
+    m_solenoidRadius(solenoidRadius),
+    m_solenoidHalfLength(solenoidHalfLength),
+    m_surfaces(nSamplings),
+    m_corrections((std::size_t)nSamplings * nEtaBins)
+  {}
+
+  void HelixCaloExtrapolator::setBarrelSurface(unsigned int sampling, float radius, float absEtaMin, float absEtaMax) {
+    if (sampling >= m_nSamplings) return;
+    m_surfaces[sampling].type = Barrel;
+    m_surfaces[sampling].position = radius;
+    m_surfaces[sampling].absEtaMin = absEtaMin;
+    m_surfaces[sampling].absEtaMax = absEtaMax;
+  }
+
+  void HelixCaloExtrapolator::setEndcapSurface(unsigned int sampling, float absZ, float absEtaMin, float absEtaMax) {
+    if (sampling >= m_nSamplings) return;
+    m_surfaces[sampling].type = Endcap;
+    m_surfaces[sampling].position = absZ;
+    m_surfaces[sampling].absEtaMin = absEtaMin;
+    m_surfaces[sampling].absEtaMax = absEtaMax;
+  }
+
+  HelixCaloExtrapolator::State HelixCaloExtrapolator::exitSolenoid(const Track& track) const {
+    State state;
+    if (track.qOverP == 0 || track.theta <= 0 || track.theta >= M_PI) return state;
+    double pt = std::sin(track.theta) / std::fabs(track.qOverP);
+    double charge = track.qOverP > 0 ? 1.0 : -1.0;
+    double cotTheta = 1.0 / std::tan(track.theta);
+    //Signed curvature (1/mm) in a field along +z: positive particles turn clockwise
+    double omega = m_field != 0 ? -charge / (pt * curvatureConstant / m_field) : 0.0;
+
+    //Transverse path length t along the helix
+    auto position = [&](double t, double& x, double& y) {
+      if (std::fabs(omega * t) < 1e-9) {
+        x = track.x + t * std::cos(track.phi0);
+        y = track.y + t * std::sin(track.phi0);
+        return;
+      }
+      x = track.x + (std::sin(track.phi0 + omega * t) - std::sin(track.phi0)) / omega;
+      y = track.y - (std::cos(track.phi0 + omega * t) - std::cos(track.phi0)) / omega;
+    };
+
+    //Exit through the barrel surface of the solenoid: the radius grows over the first half turn
+    const double infinity = std::numeric_limits<double>::infinity();
+    double tRadius = infinity;
+    double tMax = omega != 0 ? M_PI / std::fabs(omega) : 2.0 * m_solenoidRadius + std::hypot(track.x, track.y);
+    double x = 0.0, y = 0.0;
+    position(tMax, x, y);
+    if (x * x + y * y >= (double)m_solenoidRadius * m_solenoidRadius) {
+      double tLow = 0.0, tHigh = tMax;
+      for (unsigned int iteration = 0; iteration < 40; iteration++) {
+        double t = 0.5 * (tLow + tHigh);
+        position(t, x, y);
+        if (x * x + y * y < (double)m_solenoidRadius * m_solenoidRadius) tLow = t;
+        else tHigh = t;
+      }
+      tRadius = tHigh;
+    }
+    //Exit through one of the end faces
+    double tEnd = infinity;
+    if (cotTheta != 0) {
+      double zEnd = cotTheta > 0 ? m_solenoidHalfLength : -m_solenoidHalfLength;
+      tEnd = std::max(0.0, (zEnd - track.z) / cotTheta);
+    }
+    double tExit = std::min(tRadius, tEnd);
+    if (tExit == infinity) return state;
+
+    position(tExit, x, y);
+    state.valid = true;
+    state.x = x;
+    state.y = y;
+    state.z = track.z + tExit * cotTheta;
+    state.phi = wrapPhi(track.phi0 + omega * tExit);
+    state.cotTheta = cotTheta;
+    state.chargeOverPt = charge * 1000.0 / pt;
+    return state;
+  }
+
+  bool HelixCaloExtrapolator::intersect(const State& state, unsigned int sampling, bool applyCorrection, float& eta, float& phi) const {
+    if (!state.valid || sampling >= m_nSamplings) return false;
+    const Surface& surface = m_surfaces[sampling];
+    double dirX = std::cos(state.phi);
+    double dirY = std::sin(state.phi);
+    double s = 0.0;
+    if (surface.type == Barrel) {
+      //|p + s d| = R in the transverse plane, with d of unit length
+      double pd = state.x * dirX + state.y * dirY;
+      double discriminant = pd * pd - (state.x * state.x + state.y * state.y - (double)surface.position * surface.position);
+      if (discriminant < 0) return false;
+      s = -pd + std::sqrt(discriminant);
+      if (s < 0) return false;
+    }
+    else if (surface.type == Endcap) {
+      if (state.cotTheta == 0) return false;
+      double zSurface = state.cotTheta > 0 ? surface.position : -surface.position;
+      s = (zSurface - state.z) / state.cotTheta;
+      if (s < 0) return false;
+    }
+    else return false;
+
+    double x = state.x + s * dirX;
+    double y = state.y + s * dirY;
+    double z = state.z + s * state.cotTheta;
+    double r = std::hypot(x, y);
+    if (r <= 0) return false;
+    eta = std::asinh(z / r);
+    phi = std::atan2(y, x);
+    if (std::fabs(eta) < surface.absEtaMin || std::fabs(eta) >= surface.absEtaMax) return false;
+
+    if (applyCorrection) {
+      const Correction& correction = m_corrections[bin(sampling, eta)];
+      eta += eta < 0 ? -correction.deltaEta : correction.deltaEta;
+      phi = wrapPhi(phi + correction.deltaPhiSlope * state.chargeOverPt);
+    }
+    return true;
+  }
+
+  std::size_t HelixCaloExtrapolator::bin(unsigned int sampling, float eta) {
+    unsigned int etaBin = std::min((unsigned int)(std::fabs(eta) / etaBinWidth), nEtaBins - 1);
+    return (std::size_t)sampling * nEtaBins + etaBin;
+  }
+
+  bool HelixCaloExtrapolator::readCorrections(const std::string& fileName) {
+    FILE* file = std::fopen(fileName.c_str(), "r");
+    if (!file) return false;
+    char line[256];
+    bool ok = true;
+    while (std::fgets(line, sizeof(line), file)) {
+      if (line[0] == '#' || line[0] == '\n') continue;
+      unsigned int sampling = 0, etaBin = 0;
+      float deltaEta = 0.0, deltaPhiSlope = 0.0, entries = 0.0;
+      if (std::sscanf(line, "%u %u %f %f %f", &sampling, &etaBin, &deltaEta, &deltaPhiSlope, &entries) != 5 ||
+          sampling >= m_nSamplings || etaBin >= nEtaBins) {
+        ok = false;
+        break;
+      }
+      Correction& correction = m_corrections[(std::size_t)sampling * nEtaBins + etaBin];
+      correction.deltaEta = deltaEta;
+      correction.deltaPhiSlope = deltaPhiSlope;
+    }
+    std::fclose(file);
+    return ok;
+  }
+
+  HelixCaloExtrapolator::Residuals::Residuals(unsigned int nSamplings) :
+    m_nSamplings(nSamplings),
+    m_sums((std::size_t)nSamplings * nEtaBins)
+  {}
+
+  void HelixCaloExtrapolator::Residuals::add(unsigned int sampling, float helixEta, float helixPhi, float chargeOverPt, float fullEta, float fullPhi) {
+    if (sampling >= m_nSamplings) return;
+    Sums& sums = m_sums[bin(sampling, helixEta)];
+    double deltaPhi = wrapPhi(fullPhi - helixPhi);
+    sums.n += 1;
+    sums.deltaEta += helixEta < 0 ? helixEta - fullEta : fullEta - helixEta;
+    sums.xDeltaPhi += chargeOverPt * deltaPhi;
+    sums.xx += chargeOverPt * chargeOverPt;
+  }
+
+  bool HelixCaloExtrapolator::Residuals::writeCorrections(const std::string& fileName) const {
+    FILE* file = std::fopen(fileName.c_str(), "w");
+    if (!file) return false;
+    std::fprintf(file, "# sampling etaBin deltaEta deltaPhiSlope entries\n");
+    for (std::size_t i = 0; i < m_sums.size(); i++) {
+      const Sums& sums = m_sums[i];
+      if (sums.n <= 0) continue;
+      double deltaEta = sums.deltaEta / sums.n;
+      double deltaPhiSlope = sums.xx > 0 ? sums.xDeltaPhi / sums.xx : 0.0;
+      std::fprintf(file, "%u %u %.6g %.6g %.0f\n", (unsigned int)(i / nEtaBins), (unsigned int)(i % nEtaBins), deltaEta, deltaPhiSlope, sums.n);
+    }
+    return std::fclose(file) == 0;
+  }
+
+} // Derivation Framework
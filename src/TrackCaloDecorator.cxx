@@ -1,4 +1,21 @@
 #include "DerivationFrameworkEoverP/TrackCaloDecorator.h"
+#include "DerivationFrameworkEoverP/EtaPhiGridIndex.h"
+#include "DerivationFrameworkEoverP/CaloCellGeometryTable.h"
+#include "DerivationFrameworkEoverP/CaloCellEnergyArray.h"
+#include "DerivationFrameworkEoverP/CaloClusterSnapshot.h"
+#include "DerivationFrameworkEoverP/TrackImpactTable.h"
+#include "DerivationFrameworkEoverP/CaloIntersectionBuffer.h"
+#include "DerivationFrameworkEoverP/HelixCaloExtrapolator.h"
+#include "DerivationFrameworkEoverP/DeltaRKernel.h"
+#include "DerivationFrameworkEoverP/SamplingEnergyRow.h"
+#include "DerivationFrameworkEoverP/ConeRingHistogram.h"
+#include "DerivationFrameworkEoverP/CalibrationHitIndex.h"
+#include "DerivationFrameworkEoverP/TruthBarcodeTable.h"
+#include "DerivationFrameworkEoverP/ClusterCellTable.h"
+#include "DerivationFrameworkEoverP/CalibrationHitBreakdown.h"
+#include "DerivationFrameworkEoverP/ClusterHitBreakdownCache.h"
+#include "DerivationFrameworkEoverP/PdgCategory.h"
+#include "DerivationFrameworkEoverP/DeadMaterialHitIndex.h"
 #include "CaloSimEvent/CaloCalibrationHitContainer.h"  
 #include "MCTruthClassifier/IMCTruthClassifier.h"
 #include "MCTruthClassifier/MCTruthClassifierDefs.h"
@@ -6,7 +23,6 @@
 
 // tracks
 #include "TrkTrack/Track.h"
-#include "AthContainers/ConstDataVector.h"
 #include "TrkParameters/TrackParameters.h"
 #include "TrkExInterfaces/IExtrapolator.h"
 #include "xAODTruth/TruthParticleContainer.h"
@@ -19,8 +35,15 @@
 #include "TrkCaloExtension/CaloExtensionCollection.h"
 #include "TrkParametersIdentificationHelpers/TrackParametersIdHelper.h"
 #include "CaloDetDescr/CaloDepthTool.h"
+#include "StoreGate/ReadCondHandle.h"
+
+// batched extension
+#include "tbb/blocked_range.h"
+#include "tbb/parallel_for.h"
 
 // calo and cell information
+#include "CaloIdentifier/CaloDM_ID.h"
+#include "CaloDmDetDescr/CaloDmDescrManager.h"
 #include "TileEvent/TileContainer.h"
 #include "TileIdentifier/TileTBID.h"
 #include "CaloEvent/CaloCellContainer.h"
@@ -34,15 +57,38 @@
 #include "xAODCaloEvent/CaloClusterChangeSignalState.h"
 
 #include <map>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
 
 namespace DerivationFramework {
 
   TrackCaloDecorator::TrackCaloDecorator(const std::string& t, const std::string& n, const IInterface* p) : 
     AthAlgTool(t,n,p), //type, name, parent
+    m_backgroundCategories{"PhotonBackground:Photon", "HadronicBackground:Any"},
     m_sgName(""),
     m_eventInfoContainerName("EventInfo"),
     m_trackContainerName("InDetTrackParticles"),
     m_caloClusterContainerName("CaloCalTopoClusters"),
+    m_clusterGridBinSize(0.1),
+    m_cellGridBinSize(0.05),
+    m_cellConeMode("AllCells"),
+    m_cellSignificanceCut(-1.0),
+    m_clusterMatchRadius(0.3),
+    m_coneSizes{0.025, 0.050, 0.075, 0.100, 0.125, 0.150, 0.175, 0.200, 0.225, 0.250, 0.275, 0.300},
+    m_trackMinPt(-1.0),
+    m_trackMaxAbsEta(-1.0),
+    m_trackMinPixelHits(-1),
+    m_trackMinSiHits(-1),
+    m_trackMaxZ0SinTheta(-1.0),
+    m_extrapolationMode("Full"),
+    m_writeImpactPoints(false),
+    m_parallelExtension(false),
+    m_extensionThreads(0),
+    m_solenoidField(2.0),
+    m_helixValidationFraction(0.0),
+    m_helixValidationHistPath("/CutflowStream/"),
     m_extrapolator("Trk::Extrapolator"),
     m_theTrackExtrapolatorTool("Trk::ParticleCaloExtensionTool"),
     m_trackParametersIdHelper(new Trk::TrackParametersIdHelper),
@@ -58,14 +104,36 @@ namespace DerivationFramework {
       declareProperty("Extrapolator", m_extrapolator);
       declareProperty("TheTrackExtrapolatorTool", m_theTrackExtrapolatorTool);
       declareProperty("DoCutflow", m_doCutflow);
+      declareProperty("ClusterGridBinSize", m_clusterGridBinSize);
+      declareProperty("CellGridBinSize", m_cellGridBinSize);
+      declareProperty("CellConeMode", m_cellConeMode);
+      declareProperty("CellNoiseSignificanceCut", m_cellSignificanceCut);
+      declareProperty("BackgroundCategories", m_backgroundCategories);
+      declareProperty("ConeSizes", m_coneSizes);
+      declareProperty("CaloSamplings", m_samplingNames);
+      declareProperty("TrackMinPt", m_trackMinPt);
+      declareProperty("TrackMaxAbsEta", m_trackMaxAbsEta);
+      declareProperty("TrackMinPixelHits", m_trackMinPixelHits);
+      declareProperty("TrackMinSiHits", m_trackMinSiHits);
+      declareProperty("TrackMaxZ0SinTheta", m_trackMaxZ0SinTheta);
+      declareProperty("ExtrapolationMode", m_extrapolationMode);
+      declareProperty("SolenoidField", m_solenoidField);
+      declareProperty("HelixCorrectionFile", m_helixCorrectionFile);
+      declareProperty("HelixCorrectionOutputFile", m_helixCorrectionOutputFile);
+      declareProperty("HelixValidationFraction", m_helixValidationFraction);
+      declareProperty("HelixValidationHistPath", m_helixValidationHistPath);
+      declareProperty("WriteImpactPoints", m_writeImpactPoints);
+      declareProperty("ImpactPointPrefix", m_impactPointPrefix);
+      declareProperty("ParallelExtension", m_parallelExtension);
+      declareProperty("ExtensionThreads", m_extensionThreads);
+      declareProperty("TileDMHitContainer", m_tileDMHitCnt);
+      declareProperty("LArDMHitContainer", m_larDMHitCnt);
 
 
     m_tileActiveHitCnt   = "TileCalibHitActiveCell";
     m_tileInactiveHitCnt = "TileCalibHitInactiveCell";
-    m_tileDMHitCnt       = "TileCalibHitDeadMaterial";
     m_larActHitCnt   = "LArCalibrationHitActive";
     m_larInactHitCnt = "LArCalibrationHitInactive";
-    m_larDMHitCnt    = "LArCalibrationHitDeadMaterial";
 
     }
 
@@ -75,16 +143,30 @@ namespace DerivationFramework {
       ATH_MSG_WARNING("No decoration prefix name provided for the output of TrackCaloDecorator!");
     }
 
-    //Get a list of all of the sampling numbers for the calorimeter
+    if (m_nsamplings > SamplingEnergyRow::width) {
+      ATH_MSG_ERROR("There are " << m_nsamplings << " calorimeter samplings, but the sampling energy rows only have " << SamplingEnergyRow::width << " lanes");
+      return StatusCode::FAILURE;
+    }
+
+    //Get the list of sampling numbers to decorate. The matching always uses all of the samplings.
     ATH_MSG_INFO("Summing energy deposit info for layers: ");
     m_caloSamplingIndices = std::vector<unsigned int>();
     m_caloSamplingNumbers = std::vector<CaloSampling::CaloSample>();
-    m_mapCaloSamplingToIndex = std::map<CaloSampling::CaloSample, unsigned int>();
+    m_samplingIsDecorated = std::vector<bool>(m_nsamplings, m_samplingNames.empty());
+    for (const std::string& samplingName : m_samplingNames){
+        unsigned int sampling = 0;
+        while (sampling < m_nsamplings && CaloSampling::getSamplingName(sampling) != samplingName) sampling++;
+        if (sampling == m_nsamplings) {
+            ATH_MSG_ERROR("Unknown calorimeter sampling " << samplingName << " in CaloSamplings");
+            return StatusCode::FAILURE;
+        }
+        m_samplingIsDecorated[sampling] = true;
+    }
     unsigned int count = 0;
     for (unsigned int i =0; i < m_nsamplings; i++){
+        if (!m_samplingIsDecorated[i]) continue;
         m_caloSamplingNumbers.push_back((CaloSampling::CaloSample)(i));
         m_caloSamplingIndices.push_back(count);
-        m_mapCaloSamplingToIndex[(CaloSampling::CaloSample)(i)] = i;
         ATH_MSG_INFO(CaloSampling::getSamplingName(i));
         count += 1;
     }
@@ -92,21 +174,90 @@ namespace DerivationFramework {
     //Get a list of strings for each of the cuts:
     ATH_MSG_INFO("Summing energy deposits at the following radii: ");
 
-    //Assign a number to each of the cuts
-    unsigned int cutNumber = 0;
-    for(std::map<std::string,float>::const_iterator it = m_stringToCut.begin(); it != m_stringToCut.end(); ++it) {
+    //The cone bins are assigned by counting the cones that do not contain an object, so the cones must be increasing
+    if (m_cellConeMode == "AllCells") {m_doAllCellCones = true; m_doTopoCellCones = false;}
+    else if (m_cellConeMode == "TopoCells") {m_doAllCellCones = false; m_doTopoCellCones = true;}
+    else if (m_cellConeMode == "Both") {m_doAllCellCones = true; m_doTopoCellCones = true;}
+    else {
+        ATH_MSG_ERROR("Unknown CellConeMode " << m_cellConeMode << ", expected AllCells, TopoCells or Both");
+        return StatusCode::FAILURE;
+    }
+    if (m_cellSignificanceCut >= 0 && !m_doAllCellCones) {
+        ATH_MSG_WARNING("CellNoiseSignificanceCut is only used in the AllCells and Both CellConeMode");
+        m_cellSignificanceCut = -1.0;
+    }
+
+    if (m_coneSizes.empty()) {
+        ATH_MSG_ERROR("No cone sizes given in ConeSizes");
+        return StatusCode::FAILURE;
+    }
+    for (unsigned int i = 0; i < m_coneSizes.size(); i++) {
+        if (m_coneSizes[i] <= 0 || (i > 0 && m_coneSizes[i] <= m_coneSizes[i-1])) {
+            ATH_MSG_ERROR("ConeSizes must be positive and strictly increasing");
+            return StatusCode::FAILURE;
+        }
+        //the decoration names are the cone sizes rounded to 0.001 (see below), and must not repeat
+        if (i > 0 && std::lround(m_coneSizes[i] * 1000) == std::lround(m_coneSizes[i-1] * 1000)) {
+            ATH_MSG_ERROR("ConeSizes " << m_coneSizes[i-1] << " and " << m_coneSizes[i] << " give the same decoration name, the names are the cone sizes rounded to 0.001");
+            return StatusCode::FAILURE;
+        }
+    }
+    m_ncuts = m_coneSizes.size();
+
+    //Assign a number to each of the cuts. The cut name is the cone size in units of 0.001, e.g. 0.025 -> "025"
+    for (unsigned int cutNumber = 0; cutNumber < m_ncuts; cutNumber++) {
+          float cut = m_coneSizes[cutNumber];
+          char cutName[16];
+          std::snprintf(cutName, sizeof(cutName), "%03d", (int)std::lround(cut * 1000));
           m_cutNumbers.push_back(cutNumber);
-          m_cutNumberToCut[cutNumber] = it->second;
-          m_cutNumberToCutName[cutNumber] = it->first;
-          m_cutNames.push_back(it->first);
-          ATH_MSG_INFO(it->first);
-          cutNumber += 1;
+          m_cutNumberToCut[cutNumber] = cut;
+          m_cutNumberToCutName[cutNumber] = cutName;
+          m_cutNames.push_back(cutName);
+          ATH_MSG_INFO(cutName);
+          //clusters are only considered up to the largest cone
+          if (cut > m_clusterMatchRadius) m_clusterMatchRadius = cut;
+          m_coneSizeSquared.push_back(cut * cut);
+    }
+
+    //Background categories of the calibration hits
+    m_pdgClassToHitCategory.assign(PdgCategory::nClasses, s_unassignedHits);
+    m_backgroundCategoryNames.clear();
+    for (const std::string& category : m_backgroundCategories) {
+        std::size_t colon = category.find(':');
+        if (colon == std::string::npos || colon == 0) {
+            ATH_MSG_ERROR("Background category " << category << " is not of the form Name:Class+Class+...");
+            return StatusCode::FAILURE;
+        }
+        std::string classes = category.substr(colon + 1);
+        std::uint32_t mask = 0;
+        std::size_t first = 0;
+        while (first <= classes.size()) {
+            std::size_t plus = classes.find('+', first);
+            if (plus == std::string::npos) plus = classes.size();
+            std::uint32_t classMask = 0;
+            if (!PdgCategory::maskFromName(classes.substr(first, plus - first), classMask)) {
+                ATH_MSG_ERROR("Unknown particle class " << classes.substr(first, plus - first) << " in background category " << category);
+                return StatusCode::FAILURE;
+            }
+            mask |= classMask;
+            first = plus + 1;
+        }
+        unsigned int hitCategory = 1 + m_backgroundCategoryNames.size();
+        m_backgroundCategoryNames.push_back(category.substr(0, colon));
+        for (unsigned int pdgClass = 0; pdgClass < PdgCategory::nClasses; pdgClass++) {
+            if ((mask & PdgCategory::bit((PdgCategory::Class)pdgClass)) && m_pdgClassToHitCategory[pdgClass] == s_unassignedHits) {
+                m_pdgClassToHitCategory[pdgClass] = hitCategory;
+            }
+        }
     }
+    m_nHitCategories = 1 + m_backgroundCategoryNames.size();
 
     ////////////insert the decorators into the std maps
     m_cutToCaloSamplingIndexToDecorator_ClusterEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
     m_cutToCaloSamplingIndexToDecorator_LCWClusterEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
     m_cutToCaloSamplingIndexToDecorator_CellEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
+    m_cutToCaloSamplingIndexToDecorator_TopoCellEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
+    m_cutToCaloSamplingIndexToDecorator_SignificantCellEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
 
     //////////calib hits from truth matched particle/////////////
     //Active calibration hit energy
@@ -120,32 +271,14 @@ namespace DerivationFramework {
     m_cutToCaloSamplingIndexToDecorator_ClusterNonEMInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
     m_cutToCaloSamplingIndexToDecorator_ClusterInvisibleInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
     m_cutToCaloSamplingIndexToDecorator_ClusterEscapedInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    
-    //////////calib hits from background particles/////////////
-    //Active calibration hit energy
-    m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEMActiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundNonEMActiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundInvisibleActiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEscapedActiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
 
-    //Inactive calibration hit energy
-    m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEMInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundNonEMInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundInvisibleInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEscapedInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-
-    //////////calib hits from background particles/////////////
-    //Active calibration hit energy
-    m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEMActiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundNonEMActiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundInvisibleActiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEscapedActiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-
-    //Inactive calibration hit energy
-    m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEMInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundNonEMInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundInvisibleInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
-    m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEscapedInactiveCalibHitEnergy = std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts );
+    //////////calib hits from background particles, for each of the background categories/////////////
+    m_categoryToHitTypeToCutToCaloSamplingIndexToDecorator_ClusterBackgroundCalibHitEnergy = std::vector< std::vector< std::vector< std::vector<SG::AuxElement::Decorator< float > > > > >(
+        m_backgroundCategoryNames.size(),
+        std::vector< std::vector< std::vector<SG::AuxElement::Decorator< float > > > >(CalibrationHitBreakdown::nHitKinds * CalibrationHitBreakdown::nEnergyTypes,
+                                                                                       std::vector< std::vector<SG::AuxElement::Decorator< float > > >(m_ncuts)));
+    const std::string hitKindNames[CalibrationHitBreakdown::nHitKinds] = {"Active", "Inactive"};
+    const std::string energyTypeNames[CalibrationHitBreakdown::nEnergyTypes] = {"EM", "NonEM", "Invisible", "Escaped"};
 
 
     //For each of the dR cuts and m_caloSamplingNumbers, create a decoration for the tracks
@@ -172,35 +305,17 @@ namespace DerivationFramework {
             SG::AuxElement::Decorator< float > clusterNonEMInactiveCalibHitDecorator(m_sgName + "_ClusterNonEMInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
             SG::AuxElement::Decorator< float > clusterEscapedInactiveCalibHitDecorator(m_sgName + "_ClusterEscapedInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
             SG::AuxElement::Decorator< float > clusterInvisibleInactiveCalibHitDecorator(m_sgName + "_ClusterInvisibleInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            
-            //Photon Background Active CalibHit Energy Decorators
-            SG::AuxElement::Decorator< float > clusterPhotonBackgroundEMActiveCalibHitDecorator(m_sgName + "_ClusterPhotonBackgroundEMActiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterPhotonBackgroundNonEMActiveCalibHitDecorator(m_sgName + "_ClusterPhotonBackgroundNonEMActiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterPhotonBackgroundEscapedActiveCalibHitDecorator(m_sgName + "_ClusterPhotonBackgroundEscapedActiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterPhotonBackgroundInvisibleActiveCalibHitDecorator(m_sgName + "_ClusterPhotonBackgroundInvisibleActiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-
-            //Photon Background Inactive CalibHit Energy Decorators
-            SG::AuxElement::Decorator< float > clusterPhotonBackgroundEMInactiveCalibHitDecorator(m_sgName + "_ClusterPhotonBackgroundEMInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterPhotonBackgroundNonEMInactiveCalibHitDecorator(m_sgName + "_ClusterPhotonBackgroundNonEMInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterPhotonBackgroundEscapedInactiveCalibHitDecorator(m_sgName + "_ClusterPhotonBackgroundEscapedInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterPhotonBackgroundInvisibleInactiveCalibHitDecorator(m_sgName + "_ClusterPhotonBackgroundInvisibleInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-
-            //Hadronic Background Active CalibHit Energy Decorators
-            SG::AuxElement::Decorator< float > clusterHadronicBackgroundEMActiveCalibHitDecorator(m_sgName + "_ClusterHadronicBackgroundEMActiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterHadronicBackgroundNonEMActiveCalibHitDecorator(m_sgName + "_ClusterHadronicBackgroundNonEMActiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterHadronicBackgroundEscapedActiveCalibHitDecorator(m_sgName + "_ClusterHadronicBackgroundEscapedActiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterHadronicBackgroundInvisibleActiveCalibHitDecorator(m_sgName + "_ClusterHadronicBackgroundInvisibleActiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-
-            //Hadronic Background Inactive CalibHit Energy Decorators
-            SG::AuxElement::Decorator< float > clusterHadronicBackgroundEMInactiveCalibHitDecorator(m_sgName + "_ClusterHadronicBackgroundEMInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterHadronicBackgroundNonEMInactiveCalibHitDecorator(m_sgName + "_ClusterHadronicBackgroundNonEMInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterHadronicBackgroundEscapedInactiveCalibHitDecorator(m_sgName + "_ClusterHadronicBackgroundEscapedInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
-            SG::AuxElement::Decorator< float > clusterHadronicBackgroundInvisibleInactiveCalibHitDecorator(m_sgName + "_ClusterHadronicBackgroundInvisibleInactiveCalibHitEnergy_" + caloSamplingName + "_" + cutName);
 
             ////////////insert the decorators into the std maps
             m_cutToCaloSamplingIndexToDecorator_ClusterEnergy[cutNumber].push_back(clusterDecorator);
             m_cutToCaloSamplingIndexToDecorator_LCWClusterEnergy[cutNumber].push_back(lcwClusterDecorator);
-            m_cutToCaloSamplingIndexToDecorator_CellEnergy[cutNumber].push_back(cellDecorator);
+            if (m_doAllCellCones) m_cutToCaloSamplingIndexToDecorator_CellEnergy[cutNumber].push_back(cellDecorator);
+            if (m_doTopoCellCones) {
+                m_cutToCaloSamplingIndexToDecorator_TopoCellEnergy[cutNumber].push_back(SG::AuxElement::Decorator< float >(m_sgName + "_TopoCellEnergy_" + caloSamplingName + "_" + cutName));
+            }
+            if (m_cellSignificanceCut >= 0) {
+                m_cutToCaloSamplingIndexToDecorator_SignificantCellEnergy[cutNumber].push_back(SG::AuxElement::Decorator< float >(m_sgName + "_SignificantCellEnergy_" + caloSamplingName + "_" + cutName));
+            }
 
             //////////calib hits from truth matched particle/////////////
             //Active calibration hit energy
@@ -214,37 +329,29 @@ namespace DerivationFramework {
             m_cutToCaloSamplingIndexToDecorator_ClusterNonEMInactiveCalibHitEnergy[cutNumber].push_back(clusterNonEMInactiveCalibHitDecorator);
             m_cutToCaloSamplingIndexToDecorator_ClusterInvisibleInactiveCalibHitEnergy[cutNumber].push_back(clusterInvisibleInactiveCalibHitDecorator);
             m_cutToCaloSamplingIndexToDecorator_ClusterEscapedInactiveCalibHitEnergy[cutNumber].push_back(clusterEscapedInactiveCalibHitDecorator);
-            
-            //////////calib hits from background particles/////////////
-            //Active calibration hit energy
-            m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEMActiveCalibHitEnergy[cutNumber].push_back(clusterPhotonBackgroundEMActiveCalibHitDecorator);
-            m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundNonEMActiveCalibHitEnergy[cutNumber].push_back(clusterPhotonBackgroundNonEMActiveCalibHitDecorator);
-            m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundInvisibleActiveCalibHitEnergy[cutNumber].push_back(clusterPhotonBackgroundInvisibleActiveCalibHitDecorator);
-            m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEscapedActiveCalibHitEnergy[cutNumber].push_back(clusterPhotonBackgroundEscapedActiveCalibHitDecorator);
-
-            //Inactive calibration hit energy
-            m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEMInactiveCalibHitEnergy[cutNumber].push_back(clusterPhotonBackgroundEMInactiveCalibHitDecorator);
-            m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundNonEMInactiveCalibHitEnergy[cutNumber].push_back(clusterPhotonBackgroundNonEMInactiveCalibHitDecorator);
-            m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundInvisibleInactiveCalibHitEnergy[cutNumber].push_back(clusterPhotonBackgroundInvisibleInactiveCalibHitDecorator);
-            m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEscapedInactiveCalibHitEnergy[cutNumber].push_back(clusterPhotonBackgroundEscapedInactiveCalibHitDecorator);
 
             //////////calib hits from background particles/////////////
-            //Active calibration hit energy
-            m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEMActiveCalibHitEnergy[cutNumber].push_back(clusterHadronicBackgroundEMActiveCalibHitDecorator);
-            m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundNonEMActiveCalibHitEnergy[cutNumber].push_back(clusterHadronicBackgroundNonEMActiveCalibHitDecorator);
-        m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundInvisibleActiveCalibHitEnergy[cutNumber].push_back(clusterHadronicBackgroundInvisibleActiveCalibHitDecorator);
-        m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEscapedActiveCalibHitEnergy[cutNumber].push_back(clusterHadronicBackgroundEscapedActiveCalibHitDecorator);
-
-        //Inactive calibration hit energy
-        m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEMInactiveCalibHitEnergy[cutNumber].push_back(clusterHadronicBackgroundEMInactiveCalibHitDecorator);
-        m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundNonEMInactiveCalibHitEnergy[cutNumber].push_back(clusterHadronicBackgroundNonEMInactiveCalibHitDecorator);
-        m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundInvisibleInactiveCalibHitEnergy[cutNumber].push_back(clusterHadronicBackgroundInvisibleInactiveCalibHitDecorator);
-        m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEscapedInactiveCalibHitEnergy[cutNumber].push_back(clusterHadronicBackgroundEscapedInactiveCalibHitDecorator);
+            //e.g. _ClusterPhotonBackgroundEMActiveCalibHitEnergy_EMB1_100
+            for (unsigned int category = 0; category < m_backgroundCategoryNames.size(); category++) {
+                for (unsigned int kind = 0; kind < CalibrationHitBreakdown::nHitKinds; kind++) {
+                    for (unsigned int energyType = 0; energyType < CalibrationHitBreakdown::nEnergyTypes; energyType++) {
+                        const std::string decorationName = m_sgName + "_Cluster" + m_backgroundCategoryNames[category] + energyTypeNames[energyType] + hitKindNames[kind] + "CalibHitEnergy_" + caloSamplingName + "_" + cutName;
+                        m_categoryToHitTypeToCutToCaloSamplingIndexToDecorator_ClusterBackgroundCalibHitEnergy[category][kind * CalibrationHitBreakdown::nEnergyTypes + energyType][cutNumber].push_back(SG::AuxElement::Decorator< float >(decorationName));
+                    }
+                }
+            }
         }
     }
 
-    m_caloSamplingIndexToDecorator_extrapolTrackEta.reserve(m_nsamplings);
-    m_caloSamplingIndexToDecorator_extrapolTrackPhi.reserve(m_nsamplings);
+    //Dead-material calibration hit energies, one per cone
+    for (unsigned int cutNumber : m_cutNumbers){
+        std::string cutName = m_cutNumberToCutName.at(cutNumber);
+        m_cutToDecorator_DeadMaterialCalibHitEnergy.push_back(SG::AuxElement::Decorator< float >(m_sgName + "_DeadMaterialCalibHitEnergy_" + cutName));
+        m_cutToDecorator_AllDeadMaterialCalibHitEnergy.push_back(SG::AuxElement::Decorator< float >(m_sgName + "_AllDeadMaterialCalibHitEnergy_" + cutName));
+    }
+
+    m_caloSamplingIndexToDecorator_extrapolTrackEta.reserve(m_caloSamplingNumbers.size());
+    m_caloSamplingIndexToDecorator_extrapolTrackPhi.reserve(m_caloSamplingNumbers.size());
     //Create the decorators for the extrapolated track coordinates
     ATH_MSG_INFO("Perparing Decorators for the extrapolated track coordinates");
     for (unsigned int sampling_index : m_caloSamplingIndices){
@@ -253,6 +360,53 @@ namespace DerivationFramework {
         ATH_MSG_INFO(caloSamplingName);
         m_caloSamplingIndexToDecorator_extrapolTrackEta.push_back(SG::AuxElement::Decorator< float >(m_sgName + "_trkEta_" + caloSamplingName));
         m_caloSamplingIndexToDecorator_extrapolTrackPhi.push_back(SG::AuxElement::Decorator< float >(m_sgName + "_trkPhi_" + caloSamplingName));
+        m_caloSamplingIndexToDecorator_extrapolTrackExitEta.push_back(SG::AuxElement::Decorator< float >(m_sgName + "_trkExitEta_" + caloSamplingName));
+        m_caloSamplingIndexToDecorator_extrapolTrackExitPhi.push_back(SG::AuxElement::Decorator< float >(m_sgName + "_trkExitPhi_" + caloSamplingName));
+        m_caloSamplingIndexToDecorator_extrapolTrackPathLength.push_back(SG::AuxElement::Decorator< float >(m_sgName + "_trkPathLength_" + caloSamplingName));
+    }
+
+    //Fast helix extrapolation, and the comparison of the full extrapolation to it
+    m_useHelixExtrapolation = (m_extrapolationMode == "Helix");
+    m_useStoredImpactPoints = (m_extrapolationMode == "Rematch");
+    m_useFullExtrapolation = (m_extrapolationMode == "Full");
+    if (!m_useFullExtrapolation && !m_useHelixExtrapolation && !m_useStoredImpactPoints) {
+        ATH_MSG_ERROR("Unknown ExtrapolationMode " << m_extrapolationMode << ", expected Full, Helix or Rematch");
+        return StatusCode::FAILURE;
+    }
+    //In the Rematch mode the tracks already carry the decorations made with the impact point prefix,
+    //and they cannot be decorated again under the same names
+    if (m_impactPointPrefix.empty()) m_impactPointPrefix = m_sgName;
+    if (m_useStoredImpactPoints && m_impactPointPrefix == m_sgName) {
+        ATH_MSG_ERROR("The Rematch mode reads the impact points with the prefix " << m_impactPointPrefix
+                      << ", the DecorationPrefix must be different from the ImpactPointPrefix");
+        return StatusCode::FAILURE;
+    }
+    //The arena of the track by track extension is made once for the job
+    if (m_parallelExtension) {
+        m_extensionArena = std::make_unique<tbb::task_arena>(m_extensionThreads > 0 ? m_extensionThreads : (int)tbb::task_arena::automatic);
+    }
+    auto helixExtrapolator = std::make_unique<HelixCaloExtrapolator>(m_nsamplings, m_solenoidField);
+    setNominalSamplingSurfaces(*helixExtrapolator);
+    if (!m_helixCorrectionFile.empty()) {
+        if (!helixExtrapolator->readCorrections(m_helixCorrectionFile)) {
+            ATH_MSG_ERROR("Could not read the helix extrapolation corrections from " << m_helixCorrectionFile);
+            return StatusCode::FAILURE;
+        }
+    }
+    else if (m_useHelixExtrapolation) ATH_MSG_WARNING("Helix extrapolation without a HelixCorrectionFile: the positions are not corrected");
+    m_helixExtrapolator = std::move(helixExtrapolator);
+    if (!m_helixCorrectionOutputFile.empty() && m_useFullExtrapolation) {
+        m_helixResiduals = std::make_unique<HelixCaloExtrapolator::Residuals>(m_nsamplings);
+    }
+    if (m_helixValidationFraction > 0 && m_useFullExtrapolation) {
+        ServiceHandle<ITHistSvc> histSvc("THistSvc", name());
+        ATH_CHECK(histSvc.retrieve());
+        m_helixResidualEta = new TH2F((m_sgName + "_helixResidualEta").c_str(), "Full - helix extrapolation;sampling;#Delta#eta",
+                                      m_nsamplings, 0, m_nsamplings, 200, -0.05, 0.05);
+        m_helixResidualPhi = new TH2F((m_sgName + "_helixResidualPhi").c_str(), "Full - helix extrapolation;sampling;#Delta#phi",
+                                      m_nsamplings, 0, m_nsamplings, 200, -0.05, 0.05);
+        ATH_CHECK(histSvc->regHist(m_helixValidationHistPath + m_helixResidualEta->GetName(), m_helixResidualEta));
+        ATH_CHECK(histSvc->regHist(m_helixValidationHistPath + m_helixResidualPhi->GetName(), m_helixResidualPhi));
     }
 
     ATH_CHECK(m_extrapolator.retrieve());
@@ -261,6 +415,17 @@ namespace DerivationFramework {
     // Get the test beam identifier for the MBTS
     ATH_CHECK(detStore()->retrieve(m_tileTBID));
 
+    // Dead-material identifiers and regions, to place the dead-material calibration hits in eta-phi.
+    // They are only needed when a dead-material calibration hit container is configured.
+    if (!m_tileDMHitCnt.empty() || !m_larDMHitCnt.empty()) {
+        ATH_CHECK(detStore()->retrieve(m_caloDmID, "CaloDM_ID"));
+        m_caloDmDescrManager = CaloDmDescrManager::instance();
+        if (!m_caloDmDescrManager) {
+            ATH_MSG_ERROR("Could not get the CaloDmDescrManager");
+            return StatusCode::FAILURE;
+        }
+    }
+
     if(!m_caloCalClustersReadHandleKey.key().empty()) {
         ATH_CHECK(m_caloCalClustersReadHandleKey.initialize());
     }
@@ -269,12 +434,27 @@ namespace DerivationFramework {
         ATH_CHECK(m_caloCalCellsReadHandleKey.initialize());
     }
 
+    ATH_CHECK(m_caloDetDescrMgrKey.initialize());
+    ATH_CHECK(m_caloExtensionKey.initialize(!m_caloExtensionKey.key().empty() && m_useFullExtrapolation));
+    ATH_CHECK(m_caloNoiseKey.initialize(m_cellSignificanceCut >= 0));
+
 
     // Save cutflow histograms
     return StatusCode::SUCCESS;
   }
 
   StatusCode TrackCaloDecorator::finalize() {
+    if (m_clustersWithoutMoments > 0) {
+      ATH_MSG_WARNING("Couldn't retrieve some of the moments of " << m_clustersWithoutMoments << " clusters, their moment decorations are 0");
+    }
+    //Correction table of the helix extrapolation, from the residuals to the full extrapolation of this job
+    if (m_helixResiduals) {
+      if (!m_helixResiduals->writeCorrections(m_helixCorrectionOutputFile)) {
+        ATH_MSG_ERROR("Could not write the helix extrapolation corrections to " << m_helixCorrectionOutputFile);
+        return StatusCode::FAILURE;
+      }
+      ATH_MSG_INFO("Wrote the helix extrapolation corrections to " << m_helixCorrectionOutputFile);
+    }
     return StatusCode::SUCCESS;
   }
 
@@ -309,6 +489,9 @@ namespace DerivationFramework {
     const xAOD::TruthParticleContainer* truthParticles = 0;
     bool hasTruthParticles = true;
     if (!evtStore()->retrieve(truthParticles, "TruthParticles").isSuccess()){hasTruthParticles = false;}
+    //barcode -> pdgId, for the attribution of the background calibration hits
+    TruthBarcodeTable truthBarcodes;
+    if (hasTruthParticles) truthBarcodes.build(truthParticles);
 
     const CaloClusterCellLinkContainer* cclptr=0;
     if (evtStore()->contains<CaloClusterCellLinkContainer>(m_caloClusterContainerName+"_links")) {
@@ -350,6 +533,15 @@ namespace DerivationFramework {
    SG::AuxElement::Decorator< std::vector<float> > decorator_ClusterEnergyLCW_firstEnergyDensity (m_sgName + "_ClusterEnergyLCW_firstEnergyDensity");
 
    SG::AuxElement::Decorator<int> decorator_extrapolation (m_sgName + "_extrapolation");
+   SG::AuxElement::Decorator<int> decorator_preselection (m_sgName + "_preselection");
+
+   //Compact impact points: the samplings reached by the track, and its eta and phi in each of them
+   SG::AuxElement::Decorator< std::vector<unsigned char> > decorator_impactSampling (m_sgName + "_impactSampling");
+   SG::AuxElement::Decorator< std::vector<float> > decorator_impactEta (m_sgName + "_impactEta");
+   SG::AuxElement::Decorator< std::vector<float> > decorator_impactPhi (m_sgName + "_impactPhi");
+   SG::AuxElement::ConstAccessor< std::vector<unsigned char> > accessor_impactSampling (m_impactPointPrefix + "_impactSampling");
+   SG::AuxElement::ConstAccessor< std::vector<float> > accessor_impactEta (m_impactPointPrefix + "_impactEta");
+   SG::AuxElement::ConstAccessor< std::vector<float> > accessor_impactPhi (m_impactPointPrefix + "_impactPhi");
 
     // Calibration hit containers
     const CaloCalibrationHitContainer* tile_actHitCnt = 0;
@@ -367,7 +559,7 @@ namespace DerivationFramework {
     if (!evtStore()->retrieve(tile_inactHitCnt, m_tileInactiveHitCnt).isSuccess()) {
           hasCalibrationHits = false;
     }
-    if (!evtStore()->retrieve(tile_dmHitCnt,    m_tileDMHitCnt).isSuccess()) {
+    if (!m_tileDMHitCnt.empty() && !evtStore()->retrieve(tile_dmHitCnt, m_tileDMHitCnt).isSuccess()) {
           hasCalibrationHits = false;
     }
     if (!evtStore()->retrieve(lar_actHitCnt,    m_larActHitCnt).isSuccess()) {
@@ -376,21 +568,107 @@ namespace DerivationFramework {
     if (!evtStore()->retrieve(lar_inactHitCnt,  m_larInactHitCnt).isSuccess()) {
           hasCalibrationHits = false;
     }
-    if (!evtStore()->retrieve(lar_dmHitCnt,     m_larDMHitCnt).isSuccess()) {
+    if (!m_larDMHitCnt.empty() && !evtStore()->retrieve(lar_dmHitCnt, m_larDMHitCnt).isSuccess()) {
           hasCalibrationHits = false;
     }
     if (hasCalibrationHits) ATH_MSG_DEBUG("CaloCalibrationHitContainers retrieved successfuly" );
     else ATH_MSG_DEBUG("Could not retrieve CaloCalibrationHitContainers" );
 
+    //Index the active and inactive hits by (cell ID, barcode) and by cell, once per event
+    CalibrationHitIndex tile_actHitIndex;
+    CalibrationHitIndex tile_inactHitIndex;
+    CalibrationHitIndex lar_actHitIndex;
+    CalibrationHitIndex lar_inactHitIndex;
+    tile_actHitIndex.build(tile_actHitCnt);
+    tile_inactHitIndex.build(tile_inactHitCnt);
+    lar_actHitIndex.build(lar_actHitCnt);
+    lar_inactHitIndex.build(lar_inactHitCnt);
+    //Index the dead-material hits of LAr and Tile together in eta-phi
+    bool hasDeadMaterialHits = hasCalibrationHits && m_caloDmID;
+    DeadMaterialHitIndex dmHitIndex(m_clusterGridBinSize);
+    if (hasDeadMaterialHits) {
+        dmHitIndex.add(lar_dmHitCnt, *m_caloDmID, *m_caloDmDescrManager);
+        dmHitIndex.add(tile_dmHitCnt, *m_caloDmID, *m_caloDmDescrManager);
+    }
+    dmHitIndex.build();
+    std::vector<unsigned int> candidateDMHits;
+    std::vector<float> dmHitEta;
+    std::vector<float> dmHitPhi;
+    std::vector<int> dmHitBin;
+    std::vector<float> dmHitDeltaR2;
+    std::vector<float> dmConeEnergy;
+    std::vector<float> allDMConeEnergy;
+    //Cell membership of the clusters, filled for the clusters matched to any track
+    ClusterCellTable clusterCells;
+    clusterCells.reset(clusterContainer->size());
+
     //Get the primary vertex
     const xAOD::VertexContainer *vtxs(nullptr);
     CHECK(evtStore()->retrieve(vtxs, "PrimaryVertices"));
     const xAOD::Vertex *primaryVertex(nullptr);
     for( auto vtx_itr : *vtxs )
     {
-      if(vtx_itr->vertexType() != xAOD::VxType::VertexType::PriVtx) { primaryVertex = vtx_itr;}
+      if(vtx_itr->vertexType() == xAOD::VxType::VertexType::PriVtx) { primaryVertex = vtx_itr; break;}
     }
 
+    //Copy the cluster quantities used by the matching into contiguous arrays, once for all of the tracks
+    CaloClusterSnapshot clusterSnapshot;
+    fillClusterSnapshot(clusterContainer, clusterSnapshot);
+
+    //Index the clusters in eta-phi once per event, so that each track only visits the clusters near its extrapolated positions.
+    //There is one grid per sampling, holding the clusters whose most energetic layer is that sampling.
+    //Clusters without a most energetic layer (Unknown) are never matched, and are left out of the grids.
+    EtaPhiGridIndex clusterGrid(m_clusterGridBinSize, 5.0, m_nsamplings);
+    clusterGrid.build(clusterSnapshot.size, clusterSnapshot.rawEta.data(), clusterSnapshot.rawPhi.data(), clusterSnapshot.maxEnergyLayer.data());
+    std::vector<unsigned int> candidateClusters;
+    std::vector<unsigned int> candidateOrder;
+    std::vector<float> candidateEta;
+    std::vector<float> candidatePhi;
+    std::vector<int> candidateBin;
+    std::vector<float> candidateDeltaR2;
+
+    //The cell positions come from the static geometry table. Per event, the cell energies are copied into a dense array by hash.
+    SG::ReadCondHandle<CaloDetDescrManager> caloDetDescrMgrHandle(m_caloDetDescrMgrKey, eventContext);
+    std::shared_ptr<const CaloCellGeometryTable> cellGeometry = cellGeometryTable(*caloDetDescrMgrHandle);
+    //Cells above the noise significance threshold are flagged in the same pass
+    const CaloNoise* caloNoise = nullptr;
+    if (m_cellSignificanceCut >= 0) {
+      SG::ReadCondHandle<CaloNoise> caloNoiseHandle(m_caloNoiseKey, eventContext);
+      caloNoise = *caloNoiseHandle;
+    }
+    //Only the AllCells cones read the whole container, the topo-cell cones take the energies from the cells of the matched clusters
+    CaloCellEnergyArray cellEnergies;
+    if (m_doAllCellCones) {
+      cellEnergies.resize(cellGeometry->size());
+      for (const auto& cell : *caloCellContainer) {
+        if (!cell->caloDDE()) continue;
+        std::size_t hash = cell->caloDDE()->calo_hash();
+        if (hash >= cellEnergies.size()) continue;
+        cellEnergies.set(hash, cell->energy(), cell->badcell(), cell->quality(), cell->provenance());
+        if (caloNoise) {
+          float sigma = caloNoise->getNoise(IdentifierHash(hash), cell->gain());
+          if (sigma > 0 && std::fabs(cell->energy()) > m_cellSignificanceCut * sigma) cellEnergies.markSignificant(hash);
+        }
+      }
+    }
+    std::vector<unsigned int> candidateCells;
+    std::vector<float> cellEta;
+    std::vector<float> cellPhi;
+    std::vector<int> cellBin;
+    std::vector<float> cellDeltaR2;
+
+    //Per-track (ring x sampling) energies, reused for all of the tracks
+    ConeRingHistogram clusterRings_EMScale;
+    ConeRingHistogram clusterRings_LCWScale;
+    ConeRingHistogram cellRings;
+    ConeRingHistogram significantCellRings;
+    ConeRingHistogram topoCellRings;
+    CalibrationHitBreakdown hitSums(m_nHitCategories);
+    //Hit breakdowns of the matched clusters, shared by all of the tracks and cones
+    ClusterHitBreakdownCache clusterHitCache(m_nHitCategories);
+    //(hash, energy) of the cells of the clusters matched to the current track
+    std::vector<std::pair<unsigned int, float> > topoCells;
+
     bool evt_pass_all = false;
     int ntrks_all = 0;
     int ntrks_pass_all = 0;
@@ -398,19 +676,179 @@ namespace DerivationFramework {
     std::pair<unsigned int, unsigned int> res;
     MCTruthPartClassifier::ParticleDef partDef;
 
+    //Preselection of the whole container, before the calorimeter extension
+    std::vector<bool> trackPassesPreselection(trackContainer->size(), false);
+    for (const auto& track : *trackContainer) trackPassesPreselection[track->index()] = passesPreselection(track, primaryVertex);
+
+    //One calo extension per track and per event: either the collection made upstream for this track container
+    //(e.g. by CaloExtensionBuilderAlg, shared with the other clients of the extension), or one made here for the preselected tracks.
+    //With ParallelExtension, the extensions are instead made track by track in the extrapolation stage below.
+    const CaloExtensionCollection* caloExtensions = nullptr;
+    CaloExtensionCollection eventCaloExtensions;
+    if (!m_useFullExtrapolation) {
+      ATH_MSG_DEBUG("No calo extension in the ExtrapolationMode " << m_extrapolationMode);
+    }
+    else if (!m_caloExtensionKey.key().empty()) {
+      SG::ReadHandle<CaloExtensionCollection> caloExtensionReadHandle(m_caloExtensionKey, eventContext);
+      caloExtensions = caloExtensionReadHandle.cptr();
+    }
+    else if (!m_parallelExtension) {
+      ATH_CHECK(m_theTrackExtrapolatorTool->caloExtensionCollection(eventContext, *trackContainer, trackPassesPreselection, eventCaloExtensions));
+      caloExtensions = &eventCaloExtensions;
+    }
+
+    //Extrapolated track positions in every sampling, for the whole track container
+    TrackImpactTable impactTable;
+    impactTable.resize(trackContainer->size(), m_nsamplings);
+    //Helix positions of the tracks compared to the full extrapolation: uncorrected, and corrected
+    TrackImpactTable helixImpactTable;
+    TrackImpactTable correctedHelixImpactTable;
+    bool compareToHelix = m_useFullExtrapolation && (m_helixValidationFraction > 0 || !m_helixCorrectionOutputFile.empty());
+    if (compareToHelix) {
+      helixImpactTable.resize(trackContainer->size(), m_nsamplings);
+      correctedHelixImpactTable.resize(trackContainer->size(), m_nsamplings);
+    }
+    //Layer intersections of the extensions, and the entry and exit intersection of each (track, layer)
+    CaloIntersectionBuffer intersections;
+    intersections.reset(trackContainer->size());
+    std::vector<std::size_t> entryRecord(trackContainer->size() * m_nsamplings, s_noRecord);
+    std::vector<std::size_t> exitRecord(trackContainer->size() * m_nsamplings, s_noRecord);
+
+    //Extrapolation stage: the impact points of all of the preselected tracks are found before any of the matching.
+    //Calo extensions made here track by track (ParallelExtension) are computed concurrently in the task arena made at initialize.
+    std::vector<std::unique_ptr<Trk::CaloExtension> > trackExtensions;
+    if (m_useFullExtrapolation && m_caloExtensionKey.key().empty() && m_parallelExtension) {
+      trackExtensions.resize(trackContainer->size());
+      auto extendTracks = [&](const tbb::blocked_range<std::size_t>& range) {
+        for (std::size_t trackIndex = range.begin(); trackIndex < range.end(); trackIndex++) {
+          if (!trackPassesPreselection[trackIndex]) continue;
+          trackExtensions[trackIndex] = m_theTrackExtrapolatorTool->caloExtension(eventContext, *trackContainer->at(trackIndex));
+        }
+      };
+      m_extensionArena->execute([&]() {tbb::parallel_for(tbb::blocked_range<std::size_t>(0, trackContainer->size()), extendTracks);});
+    }
+
+    //The records of the extensions are then copied into the impact table in track order
+    std::vector<unsigned char> trackExtrapolated(trackContainer->size(), 0);
+    for (const auto& track : *trackContainer) {
+      const unsigned int trackIndex = track->index();
+      if (!trackPassesPreselection[trackIndex]) continue;
+
+      bool extrapolated = false;
+      std::size_t* trackEntryRecord = entryRecord.data() + (std::size_t)trackIndex * m_nsamplings;
+      std::size_t* trackExitRecord = exitRecord.data() + (std::size_t)trackIndex * m_nsamplings;
+      if (m_useStoredImpactPoints) {
+        //Impact points written by a previous run, with WriteImpactPoints. The exit decorations keep their defaults.
+        if (accessor_impactSampling.isAvailable(*track) && accessor_impactEta.isAvailable(*track) && accessor_impactPhi.isAvailable(*track)) {
+          const std::vector<unsigned char>& samplings = accessor_impactSampling(*track);
+          const std::vector<float>& etas = accessor_impactEta(*track);
+          const std::vector<float>& phis = accessor_impactPhi(*track);
+          for (std::size_t i = 0; i < samplings.size() && i < etas.size() && i < phis.size(); i++) {
+            if (samplings[i] >= m_nsamplings) continue;
+            impactTable.set(trackIndex, samplings[i], etas[i], phis[i]);
+            extrapolated = true;
+          }
+        }
+      }
+      else if (m_useHelixExtrapolation) {
+        //Corrected helix positions. The helix has no layer exits, so the exit decorations keep their defaults.
+        fillHelixImpacts(track, trackIndex, true, impactTable);
+        for (unsigned int sampling = 0; sampling < m_nsamplings; sampling++) extrapolated |= impactTable.isValid(trackIndex, sampling);
+      }
+      else {
+        /*get the CaloExtension object of this event*/
+        const Trk::CaloExtension* extension = trackExtensions.empty() ? m_theTrackExtrapolatorTool->caloExtension(*track, *caloExtensions)
+                                                                      : trackExtensions[trackIndex].get();
+
+        if (extension) {
+
+          /*extract the CurvilinearParameters per each layer-track intersection*/
+          const std::vector<Trk::CurvilinearParameters>& clParametersVector = extension->caloLayerIntersections();
+
+          intersections.beginTrack(trackIndex);
+          for (const auto& clParameter : clParametersVector) {
+
+            unsigned int parametersIdentifier = clParameter.cIdentifier();
+            CaloSampling::CaloSample intLayer;
+
+            if (!m_trackParametersIdHelper->isValid(parametersIdentifier)) {
+              std::cout << "Invalid Track Identifier"<< std::endl;
+              intLayer = CaloSampling::CaloSample::Unknown;
+            } else {
+              intLayer = (CaloSampling::CaloSample)(m_trackParametersIdHelper->caloSample(parametersIdentifier));
+            }
+            //Only the calorimeter samplings are used for matching
+            if (intLayer >= m_nsamplings) continue;
+
+            const Amg::Vector3D& position = clParameter.position();
+            intersections.add(trackIndex, intLayer, m_trackParametersIdHelper->isEntryToVolume(parametersIdentifier),
+                              position.x(), position.y(), position.z(), position.eta(), position.phi());
+          }
+
+          //Keep the first intersection with each layer, unless a later one is an entry to the layer.
+          //The exit from a layer is its last intersection that is not an entry.
+          for (std::size_t i = intersections.first(trackIndex); i < intersections.last(trackIndex); i++) {
+            const CaloIntersectionRecord& record = intersections.record(i);
+            if (trackEntryRecord[record.sampling] == s_noRecord || record.isEntry) trackEntryRecord[record.sampling] = i;
+            if (!record.isEntry) trackExitRecord[record.sampling] = i;
+          }
+          for (unsigned int sampling = 0; sampling < m_nsamplings; sampling++) {
+            if (trackEntryRecord[sampling] == s_noRecord) continue;
+            const CaloIntersectionRecord& record = intersections.record(trackEntryRecord[sampling]);
+            impactTable.set(trackIndex, sampling, record.eta, record.phi);
+          }
+
+        } else {
+          //msg(MSG::WARNING) << "TrackExtension failed for track with pt and eta " << track->pt() << " and " << track->eta() << endreq;
+        }
+        extrapolated = (extension != nullptr);
+
+        //Residuals of the helix extrapolation, for its correction table and for its validation on a fraction of the tracks
+        if (extension && compareToHelix) {
+          bool validate = false;
+          if (m_helixValidationFraction > 0) {
+            unsigned long trackCount = m_helixValidationCount++;
+            validate = std::floor((trackCount + 1) * m_helixValidationFraction) > std::floor(trackCount * m_helixValidationFraction);
+          }
+          if (validate || !m_helixCorrectionOutputFile.empty()) {
+            fillHelixImpacts(track, trackIndex, false, helixImpactTable);
+            if (validate) fillHelixImpacts(track, trackIndex, true, correctedHelixImpactTable);
+            float chargeOverPt = 1000.0 * track->qOverP() / std::sin(track->theta());
+            std::lock_guard<std::mutex> lock(m_helixMutex);
+            for (unsigned int sampling = 0; sampling < m_nsamplings; sampling++) {
+              if (!impactTable.isValid(trackIndex, sampling)) continue;
+              float fullEta = impactTable.etaAt(trackIndex, sampling);
+              float fullPhi = impactTable.phiAt(trackIndex, sampling);
+              if (!m_helixCorrectionOutputFile.empty() && helixImpactTable.isValid(trackIndex, sampling)) {
+                m_helixResiduals->add(sampling, helixImpactTable.etaAt(trackIndex, sampling), helixImpactTable.phiAt(trackIndex, sampling),
+                                      chargeOverPt, fullEta, fullPhi);
+              }
+              if (validate && correctedHelixImpactTable.isValid(trackIndex, sampling)) {
+                float deltaPhi = fullPhi - correctedHelixImpactTable.phiAt(trackIndex, sampling);
+                if (deltaPhi > M_PI) deltaPhi -= 2 * M_PI;
+                if (deltaPhi < -M_PI) deltaPhi += 2 * M_PI;
+                m_helixResidualEta->Fill(sampling, fullEta - correctedHelixImpactTable.etaAt(trackIndex, sampling));
+                m_helixResidualPhi->Fill(sampling, deltaPhi);
+              }
+            }
+          }
+        }
+      }
+      trackExtrapolated[trackIndex] = extrapolated;
+    }
+
     for (const auto& track : *trackContainer) {
+      const unsigned int trackIndex = track->index();
       //Create a calo calibration hit container for this matched particle
       //Create empty calocalibration hits containers
 
-      res = m_truthClassifier->particleTruthClassifier(track);
-      const xAOD::TruthParticle_v1* thePart = m_truthClassifier->getGenPart(track);
-      bool hasTruthPart = (thePart != NULL);
-      unsigned int particle_barcode = 0;
-      if (hasTruthPart) {particle_barcode = thePart->barcode();}
-      else {particle_barcode = 0;}
-
       // Need to record a value for every track, so using -999999999 as an invalid code
       decorator_extrapolation (*track) = 0;
+      if (m_writeImpactPoints) {
+          decorator_impactSampling (*track) = std::vector<unsigned char>();
+          decorator_impactEta (*track) = std::vector<float>();
+          decorator_impactPhi (*track) = std::vector<float>();
+      }
 
       decorator_ClusterEnergy_Energy (*track) = std::vector<float>();
       decorator_ClusterEnergy_Eta (*track) = std::vector<float>();
@@ -442,6 +880,9 @@ namespace DerivationFramework {
           CaloSampling::CaloSample caloSamplingNumber = m_caloSamplingNumbers[sampling_index];
           m_caloSamplingIndexToDecorator_extrapolTrackEta.at(sampling_index)(*track) = -999999999;
           m_caloSamplingIndexToDecorator_extrapolTrackPhi.at(sampling_index)(*track) = -999999999;
+          m_caloSamplingIndexToDecorator_extrapolTrackExitEta.at(sampling_index)(*track) = -999999999;
+          m_caloSamplingIndexToDecorator_extrapolTrackExitPhi.at(sampling_index)(*track) = -999999999;
+          m_caloSamplingIndexToDecorator_extrapolTrackPathLength.at(sampling_index)(*track) = -999999999;
       }
 
       //for (unsigned int cutNumber : m_cutNumbers){
@@ -452,51 +893,52 @@ namespace DerivationFramework {
       //    }
       //}
 
-      /*a map to store the track parameters associated with the different layers of the calorimeter system */
-      std::map<CaloSampling::CaloSample, std::unique_ptr<Trk::TrackParameters>> parametersMap;
+      //Tracks failing the preselection keep the default decorations above, and are neither classified, extrapolated nor matched
+      bool passPreselection = trackPassesPreselection[trackIndex];
+      decorator_preselection(*track) = passPreselection;
+      if (!passPreselection) continue;
 
-      /*get the CaloExtension object*/
-      std::unique_ptr<Trk::CaloExtension> extension = nullptr;
-      extension = m_theTrackExtrapolatorTool->caloExtension(eventContext, *track);
-
-      if (extension) {
-
-        /*extract the CurvilinearParameters per each layer-track intersection*/
-        const std::vector<Trk::CurvilinearParameters>& clParametersVector = extension->caloLayerIntersections();
-
-        for (auto clParameter : clParametersVector) {
-
-          unsigned int parametersIdentifier = clParameter.cIdentifier();
-          CaloSampling::CaloSample intLayer;
+      res = m_truthClassifier->particleTruthClassifier(track);
+      const xAOD::TruthParticle_v1* thePart = m_truthClassifier->getGenPart(track);
+      bool hasTruthPart = (thePart != NULL);
+      unsigned int particle_barcode = 0;
+      if (hasTruthPart) {particle_barcode = thePart->barcode();}
+      else {particle_barcode = 0;}
 
-          if (!m_trackParametersIdHelper->isValid(parametersIdentifier)) {
-            std::cout << "Invalid Track Identifier"<< std::endl;
-            intLayer = CaloSampling::CaloSample::Unknown;
-          } else {
-            intLayer = (CaloSampling::CaloSample)(m_trackParametersIdHelper->caloSample(parametersIdentifier));
-          }
+      if (!trackExtrapolated[trackIndex]) continue; //No valid parameters for any of the layers of interest
+      decorator_extrapolation(*track) = 1;
 
-          if (parametersMap[intLayer] == NULL) {
-            parametersMap[intLayer] = clParameter.uniqueClone();
-          } else if (m_trackParametersIdHelper->isEntryToVolume(clParameter.cIdentifier())) {
-            //delete parametersMap[intLayer];
-            parametersMap[intLayer] = clParameter.uniqueClone();
+      //Compact impact points in all of the samplings, to match again later without extrapolating
+      if (m_writeImpactPoints) {
+          std::vector<unsigned char> impactSampling;
+          std::vector<float> impactEta;
+          std::vector<float> impactPhi;
+          for (unsigned int sampling = 0; sampling < m_nsamplings; sampling++) {
+              if (!impactTable.isValid(trackIndex, sampling)) continue;
+              impactSampling.push_back(sampling);
+              impactEta.push_back(impactTable.etaAt(trackIndex, sampling));
+              impactPhi.push_back(impactTable.phiAt(trackIndex, sampling));
           }
-        }
-
-      } else {
-        //msg(MSG::WARNING) << "TrackExtension failed for track with pt and eta " << track->pt() << " and " << track->eta() << endreq;
+          decorator_impactSampling(*track) = impactSampling;
+          decorator_impactEta(*track) = impactEta;
+          decorator_impactPhi(*track) = impactPhi;
       }
 
-      if(!(m_theTrackExtrapolatorTool->caloExtension(eventContext, *track))) continue; //No valid parameters for any of the layers of interest
-      decorator_extrapolation(*track) = 1;
-
       //Decorate the tracks with their extrapolated coordinates
       for (unsigned int sampling_index : m_caloSamplingIndices){
           CaloSampling::CaloSample caloSamplingNumber = m_caloSamplingNumbers[sampling_index];
-          if (parametersMap[caloSamplingNumber]){
-              (m_caloSamplingIndexToDecorator_extrapolTrackPhi.at(sampling_index))(*track) = parametersMap[caloSamplingNumber]->position().phi();
-              (m_caloSamplingIndexToDecorator_extrapolTrackEta.at(sampling_index))(*track) = parametersMap[caloSamplingNumber]->position().eta();
+          if (impactTable.isValid(trackIndex, caloSamplingNumber)){
+              (m_caloSamplingIndexToDecorator_extrapolTrackPhi.at(sampling_index))(*track) = impactTable.phiAt(trackIndex, caloSamplingNumber);
+              (m_caloSamplingIndexToDecorator_extrapolTrackEta.at(sampling_index))(*track) = impactTable.etaAt(trackIndex, caloSamplingNumber);
+          }
+          //Exit point, and distance from the entry to the exit point, when the extension records an exit from the layer
+          std::size_t record = (std::size_t)trackIndex * m_nsamplings + caloSamplingNumber;
+          if (caloSamplingNumber < m_nsamplings && exitRecord[record] != s_noRecord) {
+              const CaloIntersectionRecord& exitPoint = intersections.record(exitRecord[record]);
+              const CaloIntersectionRecord& entryPoint = intersections.record(entryRecord[record]);
+              (m_caloSamplingIndexToDecorator_extrapolTrackExitEta.at(sampling_index))(*track) = exitPoint.eta;
+              (m_caloSamplingIndexToDecorator_extrapolTrackExitPhi.at(sampling_index))(*track) = exitPoint.phi;
+              (m_caloSamplingIndexToDecorator_extrapolTrackPathLength.at(sampling_index))(*track) = std::fabs(exitPoint.pathLength - entryPoint.pathLength);
           }
       }
 
@@ -507,12 +949,8 @@ namespace DerivationFramework {
       //Approach: find the most energetic layer of a cluster. Record the eta and phi coordinates of the extrapolated track at this layer//
       //Perform the matching between these track eta and phi coordinates and the energy-weighted (bary)centre eta and phi of the cluster//
 
-      //create a const data vector for each dR cut
-      std::vector<ConstDataVector<xAOD::CaloClusterContainer> > matchedClusterVector;
-      matchedClusterVector.reserve(m_ncuts);
-      for (unsigned int i = 0; i < m_ncuts; i++){
-          matchedClusterVector.push_back(ConstDataVector<xAOD::CaloClusterContainer>(SG::VIEW_ELEMENTS));
-      }
+      //create a list of matched cluster indices for each dR cut
+      std::vector<std::vector<unsigned int> > matchedClusterVector(m_ncuts);
 
 
       std::vector<float> ClusterEnergy_Energy;
@@ -541,105 +979,78 @@ namespace DerivationFramework {
       std::vector<int> ClusterEnergyLCW_IDNumber;
       std::vector<int> ClusterEnergyLCW_maxEnergyLayer;
 
-      int clusterID = 0;
-      for (const auto& cluster : *clusterContainer) {
-        clusterID += 1;
-
-        /*Finding the most energetic layer of the cluster*/
-        xAOD::CaloCluster::CaloSample mostEnergeticLayer = xAOD::CaloCluster::CaloSample::Unknown;
-        double maxLayerClusterEnergy = -999999999; //Some extremely low value
-
-        for (int i=0; i<xAOD::CaloCluster::CaloSample::TileExt2+1; i++) {
-          xAOD::CaloCluster::CaloSample sampleLayer = (xAOD::CaloCluster::CaloSample)(i);
-          double clusterLayerEnergy = cluster->eSample(sampleLayer);
-          if(clusterLayerEnergy > maxLayerClusterEnergy) {
-            maxLayerClusterEnergy = clusterLayerEnergy;
-            mostEnergeticLayer = sampleLayer;
-          }
+      //A cluster is matched using the track position in its most energetic layer, so look for clusters
+      //around the track position of each layer in the grid of that layer. Each cluster is found at most once.
+      //The cone bins of the clusters found in a layer are computed in one go, as they share the track position.
+      candidateClusters.clear();
+      for (unsigned int sampling = 0; sampling < m_nsamplings; sampling++) {
+        if (!impactTable.isValid(trackIndex, sampling)) continue;
+        std::size_t firstCandidate = candidateClusters.size();
+        //small margin to protect against the float rounding of the query position
+        clusterGrid.query(impactTable.etaAt(trackIndex, sampling), impactTable.phiAt(trackIndex, sampling), m_clusterMatchRadius + 0.001, sampling, candidateClusters);
+        std::size_t nCandidates = candidateClusters.size() - firstCandidate;
+        if (nCandidates == 0) continue;
+
+        candidateEta.resize(candidateClusters.size());
+        candidatePhi.resize(candidateClusters.size());
+        candidateBin.resize(candidateClusters.size());
+        candidateDeltaR2.resize(candidateClusters.size());
+        for (std::size_t i = firstCandidate; i < candidateClusters.size(); i++) {
+          candidateEta[i] = clusterSnapshot.rawEta[candidateClusters[i]];
+          candidatePhi[i] = clusterSnapshot.rawPhi[candidateClusters[i]];
         }
+        DeltaRKernel::coneBins(&candidateEta[firstCandidate], &candidatePhi[firstCandidate], nCandidates,
+                               impactTable.etaAt(trackIndex, sampling), impactTable.phiAt(trackIndex, sampling),
+                               m_coneSizeSquared.data(), m_ncuts, &candidateBin[firstCandidate], &candidateDeltaR2[firstCandidate]);
+      }
 
-        if(mostEnergeticLayer==xAOD::CaloCluster::CaloSample::Unknown) continue;
-
-        //do track-cluster matching at EM-Scale
-        double clEta = cluster->rawEta();
-        double clPhi = cluster->rawPhi();
-
-        if(clEta == -999 || clPhi == -999) continue;
-
-        /*Matching between the track parameters in the most energetic layer and the cluster barycentre*/
-
-        if(!parametersMap[mostEnergeticLayer]) continue;
-
-        double trackEta = parametersMap[mostEnergeticLayer]->position().eta();
-        double trackPhi = parametersMap[mostEnergeticLayer]->position().phi();
-
-        double etaDiff = clEta - trackEta;
-        double phiDiff = clPhi - trackPhi;
-
-        if (phiDiff > TMath::Pi()) phiDiff = 2 * TMath::Pi() - phiDiff;
-
-        double deltaR = std::sqrt((etaDiff*etaDiff) + (phiDiff*phiDiff));
+      //keep the container order, which defines the cluster ID numbers
+      candidateOrder.resize(candidateClusters.size());
+      for (std::size_t i = 0; i < candidateOrder.size(); i++) candidateOrder[i] = i;
+      std::sort(candidateOrder.begin(), candidateOrder.end(), [&candidateClusters](unsigned int i, unsigned int j) {return candidateClusters[i] < candidateClusters[j];});
 
-        if(deltaR < 0.3){
-          //push back the vector-like quantities that we want
-          double lambda_center;
-          double em_probability;
-          double first_energy_density;
-          double second_lambda;
-          double delta_alpha;
-          double second_r;
+      for (unsigned int candidate : candidateOrder) {
+        unsigned int clusterIndex = candidateClusters[candidate];
+        int clusterID = clusterIndex + 1;
+        int coneBin = candidateBin[candidate];
+        float deltaR2 = candidateDeltaR2[candidate];
 
+        xAOD::CaloCluster::CaloSample mostEnergeticLayer = (xAOD::CaloCluster::CaloSample)(clusterSnapshot.maxEnergyLayer[clusterIndex]);
 
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 501, lambda_center)) {ATH_MSG_WARNING("Couldn't retrieve the cluster lambda center");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 900, em_probability)) {ATH_MSG_WARNING("Couldn't rertieve the EM Probability");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 804, first_energy_density)) {ATH_MSG_WARNING("Couldn't rertieve the first energy density moment");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 303, delta_alpha)) {ATH_MSG_WARNING("Couldn't rertieve the delta alpha moment");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 202, second_lambda)) {ATH_MSG_WARNING("Couldn't rertieve the second lambda moment");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 202, second_r)) {ATH_MSG_WARNING("Couldn't rertieve the second radial");}
+        if(deltaR2 < s_clusterDecorationDeltaR * s_clusterDecorationDeltaR){
+          float deltaR = std::sqrt(deltaR2);
 
           //we want to include the information about these clusters in the derivation output
-          ClusterEnergy_Energy.push_back(cluster->rawE()); //Raw Energy
-          ClusterEnergy_Eta.push_back(cluster->rawEta()); //Eta and phi based on EM Scale
-          ClusterEnergy_Phi.push_back(cluster->rawPhi()); //Eta and phi based on EM Scale
+          ClusterEnergy_Energy.push_back(clusterSnapshot.rawE[clusterIndex]); //Raw Energy
+          ClusterEnergy_Eta.push_back(clusterSnapshot.rawEta[clusterIndex]); //Eta and phi based on EM Scale
+          ClusterEnergy_Phi.push_back(clusterSnapshot.rawPhi[clusterIndex]); //Eta and phi based on EM Scale
           ClusterEnergy_dRToTrack.push_back(deltaR);
 
-          ClusterEnergy_lambdaCenter.push_back(lambda_center);
-          ClusterEnergy_secondLambda.push_back(second_lambda);
-          ClusterEnergy_deltaAlpha.push_back(delta_alpha);
-          ClusterEnergy_secondR.push_back(second_r);
+          ClusterEnergy_lambdaCenter.push_back(clusterSnapshot.lambdaCenter[clusterIndex]);
+          ClusterEnergy_secondLambda.push_back(clusterSnapshot.secondLambda[clusterIndex]);
+          ClusterEnergy_deltaAlpha.push_back(clusterSnapshot.deltaAlpha[clusterIndex]);
+          ClusterEnergy_secondR.push_back(clusterSnapshot.secondLambda[clusterIndex]);
 
           ClusterEnergy_maxEnergyLayer.push_back(mostEnergeticLayer);
-          ClusterEnergy_emProbability.push_back(em_probability);
+          ClusterEnergy_emProbability.push_back(clusterSnapshot.emProbability[clusterIndex]);
           ClusterEnergy_IDNumber.push_back(clusterID);
-          ClusterEnergy_firstEnergyDensity.push_back(first_energy_density);
-          
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 501, lambda_center)) {ATH_MSG_WARNING("Couldn't retrieve the cluster lambda center");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 900, em_probability)) {ATH_MSG_WARNING("Couldn't rertieve the EM Probability");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 804, first_energy_density)) {ATH_MSG_WARNING("Couldn't rertieve the first energy density moment");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 303, delta_alpha)) {ATH_MSG_WARNING("Couldn't rertieve the delta alpha moment");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 202, second_lambda)) {ATH_MSG_WARNING("Couldn't rertieve the second lambda moment");}
-          if (!cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 202, second_r)) {ATH_MSG_WARNING("Couldn't rertieve the second radial");}
-          ClusterEnergyLCW_Energy.push_back(cluster->e());   //LCW Energy
-          ClusterEnergyLCW_Eta.push_back(cluster->calEta()); // Eta and phi at LCW Scale
-          ClusterEnergyLCW_Phi.push_back(cluster->calPhi()); // Eta and phi at LCW Scale
+          ClusterEnergy_firstEnergyDensity.push_back(clusterSnapshot.firstEnergyDensity[clusterIndex]);
+
+          ClusterEnergyLCW_Energy.push_back(clusterSnapshot.e[clusterIndex]);   //LCW Energy
+          ClusterEnergyLCW_Eta.push_back(clusterSnapshot.calEta[clusterIndex]); // Eta and phi at LCW Scale
+          ClusterEnergyLCW_Phi.push_back(clusterSnapshot.calPhi[clusterIndex]); // Eta and phi at LCW Scale
           ClusterEnergyLCW_dRToTrack.push_back(deltaR);
-          ClusterEnergyLCW_lambdaCenter.push_back(lambda_center);
-          ClusterEnergyLCW_secondLambda.push_back(second_lambda);
-          ClusterEnergyLCW_deltaAlpha.push_back(delta_alpha);
-          ClusterEnergyLCW_secondR.push_back(second_r);
+          ClusterEnergyLCW_lambdaCenter.push_back(clusterSnapshot.lambdaCenter[clusterIndex]);
+          ClusterEnergyLCW_secondLambda.push_back(clusterSnapshot.secondLambda[clusterIndex]);
+          ClusterEnergyLCW_deltaAlpha.push_back(clusterSnapshot.deltaAlpha[clusterIndex]);
+          ClusterEnergyLCW_secondR.push_back(clusterSnapshot.secondLambda[clusterIndex]);
           ClusterEnergyLCW_maxEnergyLayer.push_back(mostEnergeticLayer);
-          ClusterEnergyLCW_emProbability.push_back(em_probability);
+          ClusterEnergyLCW_emProbability.push_back(clusterSnapshot.emProbability[clusterIndex]);
           ClusterEnergyLCW_IDNumber.push_back(clusterID);
-          ClusterEnergyLCW_firstEnergyDensity.push_back(first_energy_density);
-        }
-        //Loop through the different dR Cuts, and push to the matched cluster container
-        for (unsigned int cutNumber: m_cutNumbers){
-            float cut = m_cutNumberToCut.at(cutNumber);
-            if (deltaR < cut) {
-                matchedClusterVector.at(cutNumber).push_back(cluster);
-                break;
-            }
+          ClusterEnergyLCW_firstEnergyDensity.push_back(clusterSnapshot.firstEnergyDensity[clusterIndex]);
         }
+        //Push to the matched clusters of the smallest cone containing the cluster
+        if (coneBin < (int)m_ncuts) matchedClusterVector.at(coneBin).push_back(clusterIndex);
       }
 
       //Decorate the tracks with the vector-like quantities
@@ -672,307 +1083,378 @@ namespace DerivationFramework {
       //Approach: loop over cell container, getting the eta and phi coordinates of each cell for each layer.//
       //Perform a match between the cell and the track eta and phi coordinates in the cell's sampling layer.//
       //
-      std::vector<ConstDataVector<CaloCellContainer> > matchedCellVector;
-      matchedCellVector.reserve(m_ncuts);
-      for (unsigned int i = 0; i < m_ncuts; i++){
-          matchedCellVector.push_back(ConstDataVector<CaloCellContainer>(SG::VIEW_ELEMENTS));
+      //Each matched cell is added once, to the ring of the smallest cone containing it
+      cellRings.reset(m_ncuts);
+      significantCellRings.reset(m_ncuts);
+
+      for (unsigned int sampling = 0; sampling < m_nsamplings; sampling++) {
+          if (!m_doAllCellCones) break;
+          //cell energies are only summed for the decorated samplings, and not for the forward calorimeters
+          if (!m_samplingIsDecorated[sampling]) continue;
+          if (sampling > CaloSampling::TileExt2) continue;
+          if (!impactTable.isValid(trackIndex, sampling)) continue;
+          candidateCells.clear();
+          cellGeometry->query(sampling, impactTable.etaAt(trackIndex, sampling), impactTable.phiAt(trackIndex, sampling),
+                              m_clusterMatchRadius + 0.001, candidateCells);
+          unsigned int nCells = candidateCells.size();
+          if (nCells == 0) continue;
+          //Keep the cells in hash order, as in the cell container
+          std::sort(candidateCells.begin(), candidateCells.end());
+
+          cellEta.resize(nCells);
+          cellPhi.resize(nCells);
+          for (unsigned int i = 0; i < nCells; i++) {
+              cellEta[i] = cellGeometry->eta(candidateCells[i]);
+              cellPhi[i] = cellGeometry->phi(candidateCells[i]);
+          }
+          cellBin.resize(nCells);
+          cellDeltaR2.resize(nCells);
+          DeltaRKernel::coneBins(cellEta.data(), cellPhi.data(), nCells,
+                                 impactTable.etaAt(trackIndex, sampling), impactTable.phiAt(trackIndex, sampling),
+                                 m_coneSizeSquared.data(), m_ncuts, cellBin.data(), cellDeltaR2.data());
+          for (unsigned int i = 0; i < nCells; i++) {
+              if (cellBin[i] >= (int)m_ncuts) continue;
+              //Cells missing from this event's container are skipped
+              unsigned int cellHash = candidateCells[i];
+              if (!cellEnergies.isPresent(cellHash)) continue;
+              cellRings.add(cellBin[i], sampling, cellEnergies.energy[cellHash]);
+              if (cellEnergies.isSignificant(cellHash)) significantCellRings.add(cellBin[i], sampling, cellEnergies.energy[cellHash]);
+          }
       }
 
-      for (const auto& cell : *caloCellContainer) {
-
-          if (!cell->caloDDE()) continue;
-
-          CaloCell_ID::CaloSample cellLayer = cell->caloDDE()->getSampling();
-
-          if(cellLayer>CaloCell_ID::CaloSample::TileExt2) continue;
-
-          double cellEta = cell->eta();
-          double cellPhi = cell->phi();
-
-          if(cellEta == -999 || cellPhi == -999) continue;
-
-          if(!parametersMap[cellLayer]) continue;
-
-          double trackEta = parametersMap[cellLayer]->position().eta();
-          double trackPhi = parametersMap[cellLayer]->position().phi();
-
-          double etaDiff = cellEta - trackEta;
-          double phiDiff = cellPhi - trackPhi;
-
-          if (phiDiff > TMath::Pi()) phiDiff = 2*TMath::Pi() - phiDiff;
-
-          double deltaR = std::sqrt((etaDiff*etaDiff) + (phiDiff*phiDiff));
-
-          for (unsigned int cutNumber: m_cutNumbers){
-              float cut = m_cutNumberToCut.at(cutNumber);
-              if (deltaR < cut) {
-                  matchedCellVector.at(cutNumber).push_back(cell);
-                  break;
+      cellRings.accumulate();
+      significantCellRings.accumulate();
+
+      //Topo-cell cones: the cells of the clusters matched to the track, each counted once even if shared between clusters
+      topoCellRings.reset(m_ncuts);
+      if (m_doTopoCellCones) {
+          topoCells.clear();
+          for (const std::vector<unsigned int>& clusterIndices : matchedClusterVector) {
+              for (unsigned int clusterIndex : clusterIndices) {
+                  const CaloClusterCellLink* cellLinks = clusterContainer->at(clusterIndex)->getCellLinks();
+                  if (!cellLinks) continue;
+                  for (const CaloCell* cell : *cellLinks) {
+                      if (!cell->caloDDE()) continue;
+                      std::size_t hash = cell->caloDDE()->calo_hash();
+                      if (cellGeometry->isIndexed(hash)) topoCells.emplace_back(hash, cell->energy());
+                  }
+              }
+          }
+          //group the cells by sampling, so that each sampling is matched to its own track position
+          std::sort(topoCells.begin(), topoCells.end(), [&cellGeometry](const std::pair<unsigned int, float>& i, const std::pair<unsigned int, float>& j) {
+              unsigned int si = cellGeometry->sampling(i.first);
+              unsigned int sj = cellGeometry->sampling(j.first);
+              return si < sj || (si == sj && i.first < j.first);
+          });
+          topoCells.erase(std::unique(topoCells.begin(), topoCells.end(),
+                                      [](const std::pair<unsigned int, float>& i, const std::pair<unsigned int, float>& j) {return i.first == j.first;}),
+                          topoCells.end());
+
+          std::size_t first = 0;
+          while (first < topoCells.size()) {
+              unsigned int sampling = cellGeometry->sampling(topoCells[first].first);
+              std::size_t last = first;
+              while (last < topoCells.size() && cellGeometry->sampling(topoCells[last].first) == sampling) last++;
+              unsigned int nCells = last - first;
+              if (m_samplingIsDecorated[sampling] && sampling <= CaloSampling::TileExt2 && impactTable.isValid(trackIndex, sampling)) {
+                  cellEta.resize(nCells);
+                  cellPhi.resize(nCells);
+                  for (unsigned int i = 0; i < nCells; i++) {
+                      cellEta[i] = cellGeometry->eta(topoCells[first + i].first);
+                      cellPhi[i] = cellGeometry->phi(topoCells[first + i].first);
+                  }
+                  cellBin.resize(nCells);
+                  cellDeltaR2.resize(nCells);
+                  DeltaRKernel::coneBins(cellEta.data(), cellPhi.data(), nCells,
+                                         impactTable.etaAt(trackIndex, sampling), impactTable.phiAt(trackIndex, sampling),
+                                         m_coneSizeSquared.data(), m_ncuts, cellBin.data(), cellDeltaR2.data());
+                  for (unsigned int i = 0; i < nCells; i++) {
+                      if (cellBin[i] < (int)m_ncuts) topoCellRings.add(cellBin[i], sampling, topoCells[first + i].second);
+                  }
               }
+              first = last;
           }
       }
+      topoCellRings.accumulate();
 
-      std::vector<float> caloSamplingIndexToEnergySum_EMScale(m_nsamplings);
-      std::vector<float> caloSamplingIndexToEnergySum_LCWScale(m_nsamplings);
-
-      //EM == 0
-      //NonEM == 1
-      //Invisible == 2
-      //Escaped == 3
-      std::vector< std::vector<float> > energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit(4, std::vector<float>(m_nsamplings));
-      std::vector< std::vector<float> > energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit(4, std::vector<float>(m_nsamplings));
-
-      std::vector< std::vector<float> > photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit(4, std::vector<float>(m_nsamplings));
-      std::vector< std::vector<float> > photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit(4, std::vector<float>(m_nsamplings));
-
-      std::vector< std::vector<float> > hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit(4, std::vector<float>(m_nsamplings));
-      std::vector< std::vector<float> > hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit(4, std::vector<float>(m_nsamplings));
-
-      for (unsigned int sampling_index : m_caloSamplingIndices){
-          CaloSampling::CaloSample caloSamplingNumber = m_caloSamplingNumbers[sampling_index];
-          caloSamplingIndexToEnergySum_EMScale[sampling_index] = 0.0;
-          caloSamplingIndexToEnergySum_LCWScale[sampling_index] = 0.0;
-
-          energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[0][sampling_index] = 0.0;
-          energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[1][sampling_index] = 0.0;
-          energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[2][sampling_index] = 0.0;
-          energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[3][sampling_index] = 0.0;
-
-          energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[0][sampling_index] = 0.0;
-          energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[1][sampling_index] = 0.0;
-          energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[2][sampling_index] = 0.0;
-          energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[3][sampling_index] = 0.0;
-
-          photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[0][sampling_index] = 0.0;
-          photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[1][sampling_index] = 0.0;
-          photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[2][sampling_index] = 0.0;
-          photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[3][sampling_index] = 0.0;
-
-          hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[0][sampling_index] = 0.0;
-          hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[1][sampling_index] = 0.0;
-          hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[2][sampling_index] = 0.0;
-          hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[3][sampling_index] = 0.0;
-
+      //Cluster energies: each matched cluster is added once to its ring, then the rings are summed into cones
+      clusterRings_EMScale.reset(m_ncuts);
+      clusterRings_LCWScale.reset(m_ncuts);
+      for (unsigned int cutNumber : m_cutNumbers){
+          for (unsigned int clusterIndex : matchedClusterVector.at(cutNumber)) {
+              float cluster_weight = clusterSnapshot.calE[clusterIndex]/clusterSnapshot.rawE[clusterIndex];
+              //all of the samplings at once: the rows are indexed by sampling number
+              clusterRings_EMScale.addRow(cutNumber, clusterSnapshot.eSampleRow(clusterIndex));
+              clusterRings_LCWScale.addScaledRow(cutNumber, clusterSnapshot.eSampleRow(clusterIndex), cluster_weight);
+          }
       }
+      clusterRings_EMScale.accumulate();
+      clusterRings_LCWScale.accumulate();
 
-      std::vector<int> PhotonPDGID;
-      PhotonPDGID.push_back(22);
-      std::vector<int> EmptyVectorPDGID;
+      //Calibration hit energies of the matched clusters, split by hit kind (active/inactive), attribution (signal or a background category),
+      //energy type (EM/NonEM/Invisible/Escaped) and sampling. They are only decorated when the calibration hits and the truth are available.
+      bool doCalibHits = hasCalibrationHits && hasTruthParticles;
+      hitSums.clear();
 
       for (unsigned int cutNumber: m_cutNumbers){
           std::string cutName = m_cutNumberToCutName.at(cutNumber);
-          //create std::maps of std::string CaloRegion -> float Energy Sum
-          ConstDataVector<xAOD::CaloClusterContainer>::iterator firstMatchedClus = matchedClusterVector.at(cutNumber).begin();
-          ConstDataVector<xAOD::CaloClusterContainer>::iterator lastMatchedClus = matchedClusterVector.at(cutNumber).end();
-
-          /*Loop over matched clusters for a given cone dimension*/
-          for (; firstMatchedClus != lastMatchedClus; ++firstMatchedClus) {
-
-              const xAOD::CaloCluster* cl = *firstMatchedClus;
-              float energy_EM = -999999999;
-              float energy_LCW = -999999999;
-
-              energy_EM = cl->rawE();
-              energy_LCW = cl->calE();
-              double cluster_weight = energy_LCW/energy_EM;
-
-              if(energy_EM == -999999999 || energy_LCW == -999999999) continue;
-
-              for (unsigned int sampling_index : m_caloSamplingIndices){
-                  CaloSampling::CaloSample caloSamplingNumber = m_caloSamplingNumbers[sampling_index];
-                  caloSamplingIndexToEnergySum_EMScale[sampling_index] += cl->eSample(caloSamplingNumber);
-                  caloSamplingIndexToEnergySum_LCWScale[sampling_index] += cluster_weight*(cl->eSample(caloSamplingNumber));
+          /*Loop over matched clusters for a given cone dimension, the sums are cumulative over the cones*/
+          for (unsigned int clusterIndex : matchedClusterVector.at(cutNumber)) {
+              if (!doCalibHits || particle_barcode == 0) break;
+              const CalibrationHitBreakdown* clusterHits = clusterHitCache.find(clusterIndex, particle_barcode);
+              if (!clusterHits) {
+                  CalibrationHitBreakdown& newClusterHits = clusterHitCache.insert(clusterIndex, particle_barcode);
+                  clusterCells.fill(clusterIndex, clusterContainer->at(clusterIndex));
+                  sumClusterHits(lar_actHitIndex, CalibrationHitBreakdown::Active, clusterCells, clusterIndex, particle_barcode, truthBarcodes, newClusterHits);
+                  sumClusterHits(lar_inactHitIndex, CalibrationHitBreakdown::Inactive, clusterCells, clusterIndex, particle_barcode, truthBarcodes, newClusterHits);
+                  sumClusterHits(tile_actHitIndex, CalibrationHitBreakdown::Active, clusterCells, clusterIndex, particle_barcode, truthBarcodes, newClusterHits);
+                  sumClusterHits(tile_inactHitIndex, CalibrationHitBreakdown::Inactive, clusterCells, clusterIndex, particle_barcode, truthBarcodes, newClusterHits);
+                  clusterHits = &newClusterHits;
               }
-
-              getHitsSum(lar_actHitCnt, cl, particle_barcode, energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit);
-              getHitsSum(lar_inactHitCnt, cl, particle_barcode, energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit);
-              getHitsSum(tile_actHitCnt, cl, particle_barcode, energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit);
-              getHitsSum(tile_inactHitCnt, cl, particle_barcode, energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit);
-
-
-              if (hasCalibrationHits and hasTruthParticles){
-                  getHitsSumAllBackground(lar_actHitCnt ,cl, particle_barcode, truthParticles, PhotonPDGID, EmptyVectorPDGID, photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit);
-                  getHitsSumAllBackground(lar_inactHitCnt ,cl, particle_barcode, truthParticles, PhotonPDGID, EmptyVectorPDGID, photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit);
-                  getHitsSumAllBackground(tile_actHitCnt ,cl, particle_barcode, truthParticles, PhotonPDGID, EmptyVectorPDGID, photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit);
-                  getHitsSumAllBackground(tile_inactHitCnt ,cl, particle_barcode, truthParticles, PhotonPDGID, EmptyVectorPDGID, photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit);
-
-                  getHitsSumAllBackground(lar_actHitCnt ,cl, particle_barcode, truthParticles, EmptyVectorPDGID, PhotonPDGID, hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit);
-                  getHitsSumAllBackground(lar_inactHitCnt ,cl, particle_barcode, truthParticles, EmptyVectorPDGID, PhotonPDGID, hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit);
-                  getHitsSumAllBackground(tile_actHitCnt ,cl, particle_barcode, truthParticles, EmptyVectorPDGID, PhotonPDGID, hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit);
-                  getHitsSumAllBackground(tile_inactHitCnt ,cl, particle_barcode, truthParticles, EmptyVectorPDGID, PhotonPDGID, hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit);
-              }
-
-
+              hitSums.add(*clusterHits);
           }
           for (unsigned int sampling_index : m_caloSamplingIndices){
               CaloSampling::CaloSample caloSamplingNumber = m_caloSamplingNumbers[sampling_index];
 
               //Decorate the tracks with the sum of the hits
-              (m_cutToCaloSamplingIndexToDecorator_ClusterEnergy.at(cutNumber).at(sampling_index))(*track) = caloSamplingIndexToEnergySum_EMScale.at(sampling_index);
-              (m_cutToCaloSamplingIndexToDecorator_LCWClusterEnergy.at(cutNumber).at(sampling_index))(*track) = caloSamplingIndexToEnergySum_LCWScale.at(sampling_index);
-
-              if (hasCalibrationHits and hasTruthParticles){
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterEMActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[0][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterNonEMActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[1][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterInvisibleActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[2][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterEscapedActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = energyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[3][sampling_index];
-
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterEMInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[0][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterNonEMInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[1][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterInvisibleInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[2][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterEscapedInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = energyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[3][sampling_index];
-
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEMActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[0][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundNonEMActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[1][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundInvisibleActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[2][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEscapedActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[3][sampling_index];
-
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEMInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[0][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundNonEMInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[1][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundInvisibleInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[2][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterPhotonBackgroundEscapedInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = photonBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[3][sampling_index];
-
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEMActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[0][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundNonEMActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[1][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundInvisibleActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[2][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEscapedActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_ActiveCalibHit[3][sampling_index];
-
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEMInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[0][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundNonEMInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[1][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundInvisibleInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[2][sampling_index];
-                  (m_cutToCaloSamplingIndexToDecorator_ClusterHadronicBackgroundEscapedInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hadronicBkgEnergyTypeToCaloSamplingIndexToEnergySum_InactiveCalibHit[3][sampling_index];
+              (m_cutToCaloSamplingIndexToDecorator_ClusterEnergy.at(cutNumber).at(sampling_index))(*track) = clusterRings_EMScale.at(cutNumber, caloSamplingNumber);
+              (m_cutToCaloSamplingIndexToDecorator_LCWClusterEnergy.at(cutNumber).at(sampling_index))(*track) = clusterRings_LCWScale.at(cutNumber, caloSamplingNumber);
+
+              if (doCalibHits){
+                  (m_cutToCaloSamplingIndexToDecorator_ClusterEMActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hitSums.at(CalibrationHitBreakdown::Active, s_signalHits, 0, caloSamplingNumber);
+                  (m_cutToCaloSamplingIndexToDecorator_ClusterNonEMActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hitSums.at(CalibrationHitBreakdown::Active, s_signalHits, 1, caloSamplingNumber);
+                  (m_cutToCaloSamplingIndexToDecorator_ClusterInvisibleActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hitSums.at(CalibrationHitBreakdown::Active, s_signalHits, 2, caloSamplingNumber);
+                  (m_cutToCaloSamplingIndexToDecorator_ClusterEscapedActiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hitSums.at(CalibrationHitBreakdown::Active, s_signalHits, 3, caloSamplingNumber);
+
+                  (m_cutToCaloSamplingIndexToDecorator_ClusterEMInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hitSums.at(CalibrationHitBreakdown::Inactive, s_signalHits, 0, caloSamplingNumber);
+                  (m_cutToCaloSamplingIndexToDecorator_ClusterNonEMInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hitSums.at(CalibrationHitBreakdown::Inactive, s_signalHits, 1, caloSamplingNumber);
+                  (m_cutToCaloSamplingIndexToDecorator_ClusterInvisibleInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hitSums.at(CalibrationHitBreakdown::Inactive, s_signalHits, 2, caloSamplingNumber);
+                  (m_cutToCaloSamplingIndexToDecorator_ClusterEscapedInactiveCalibHitEnergy.at(cutNumber).at(sampling_index))(*track) = hitSums.at(CalibrationHitBreakdown::Inactive, s_signalHits, 3, caloSamplingNumber);
+
+                  for (unsigned int category = 0; category < m_backgroundCategoryNames.size(); category++) {
+                      for (unsigned int kind = 0; kind < CalibrationHitBreakdown::nHitKinds; kind++) {
+                          for (unsigned int energyType = 0; energyType < CalibrationHitBreakdown::nEnergyTypes; energyType++) {
+                              (m_categoryToHitTypeToCutToCaloSamplingIndexToDecorator_ClusterBackgroundCalibHitEnergy[category][kind * CalibrationHitBreakdown::nEnergyTypes + energyType].at(cutNumber).at(sampling_index))(*track) = hitSums.at(kind, 1 + category, energyType, caloSamplingNumber);
+                          }
+                      }
+                  }
               }
 
           }//close loop over calo sampling numbers
           ATH_MSG_DEBUG("Done looping over clusters for cut " + cutName);
       }//close loop over cut names
 
-      //sum energy deposits from cells
-      std::vector<float> caloSamplingIndexToEnergySum_CellEnergy(m_nsamplings);
-      for (unsigned int sampling_index : m_caloSamplingIndices){
-          CaloSampling::CaloSample caloSamplingNumber = m_caloSamplingNumbers[sampling_index];
-          caloSamplingIndexToEnergySum_CellEnergy[sampling_index] = 0.0;
+      //Dead-material calibration hits in cones around the track position in the first calorimeter layer it crosses.
+      //The hits are looked up in the per-event grid, and each hit is added once to the ring of the smallest cone containing it.
+      //The sum over all particles needs no truth, only the sum of the matched particle does.
+      if (hasDeadMaterialHits) {
+          dmConeEnergy.assign(m_ncuts, 0.0);
+          allDMConeEnergy.assign(m_ncuts, 0.0);
+          unsigned int frontSampling = 0;
+          while (frontSampling <= CaloSampling::TileExt2 && !impactTable.isValid(trackIndex, frontSampling)) frontSampling++;
+          if (frontSampling <= CaloSampling::TileExt2) {
+              float trackEta = impactTable.etaAt(trackIndex, frontSampling);
+              float trackPhi = impactTable.phiAt(trackIndex, frontSampling);
+              candidateDMHits.clear();
+              dmHitIndex.query(trackEta, trackPhi, m_clusterMatchRadius + 0.001, candidateDMHits);
+              unsigned int nHits = candidateDMHits.size();
+              dmHitEta.resize(nHits);
+              dmHitPhi.resize(nHits);
+              for (unsigned int i = 0; i < nHits; i++) {
+                  dmHitEta[i] = dmHitIndex.eta(candidateDMHits[i]);
+                  dmHitPhi[i] = dmHitIndex.phi(candidateDMHits[i]);
+              }
+              dmHitBin.resize(nHits);
+              dmHitDeltaR2.resize(nHits);
+              DeltaRKernel::coneBins(dmHitEta.data(), dmHitPhi.data(), nHits, trackEta, trackPhi,
+                                     m_coneSizeSquared.data(), m_ncuts, dmHitBin.data(), dmHitDeltaR2.data());
+              for (unsigned int i = 0; i < nHits; i++) {
+                  if (dmHitBin[i] >= (int)m_ncuts) continue;
+                  float energy = dmHitIndex.energy(candidateDMHits[i]);
+                  allDMConeEnergy[dmHitBin[i]] += energy;
+                  if (doCalibHits && particle_barcode != 0 && dmHitIndex.barcode(candidateDMHits[i]) == particle_barcode) dmConeEnergy[dmHitBin[i]] += energy;
+              }
+          }
+          for (unsigned int cutNumber = 1; cutNumber < m_ncuts; cutNumber++) {
+              dmConeEnergy[cutNumber] += dmConeEnergy[cutNumber - 1];
+              allDMConeEnergy[cutNumber] += allDMConeEnergy[cutNumber - 1];
+          }
+          for (unsigned int cutNumber : m_cutNumbers){
+              if (doCalibHits) (m_cutToDecorator_DeadMaterialCalibHitEnergy.at(cutNumber))(*track) = dmConeEnergy[cutNumber];
+              (m_cutToDecorator_AllDeadMaterialCalibHitEnergy.at(cutNumber))(*track) = allDMConeEnergy[cutNumber];
+          }
       }
+
+      //Decorate the tracks with the cell energy deposits in the correct layers
       for (unsigned int cutNumber : m_cutNumbers){
-          ConstDataVector<CaloCellContainer>::iterator firstMatchedCell = matchedCellVector.at(cutNumber).begin();
-          ConstDataVector<CaloCellContainer>::iterator lastMatchedCell = matchedCellVector.at(cutNumber).end();
-          for (; firstMatchedCell != lastMatchedCell; ++firstMatchedCell) {
-              if (!(*firstMatchedCell)->caloDDE()) continue;
-              CaloCell_ID::CaloSample cellLayer = (*firstMatchedCell)->caloDDE()->getSampling();
-              caloSamplingIndexToEnergySum_CellEnergy.at(m_mapCaloSamplingToIndex.at(((CaloSampling::CaloSample)(cellLayer)))) += (*firstMatchedCell)->energy();
-          }
-          //Decorate the tracks with the energy deposits in the correct layers
           for (unsigned int sampling_index : m_caloSamplingIndices){
-              (m_cutToCaloSamplingIndexToDecorator_CellEnergy.at(cutNumber).at(sampling_index))(*track) = caloSamplingIndexToEnergySum_CellEnergy.at(sampling_index);
+              if (m_doAllCellCones) {
+                  (m_cutToCaloSamplingIndexToDecorator_CellEnergy.at(cutNumber).at(sampling_index))(*track) = cellRings.at(cutNumber, m_caloSamplingNumbers[sampling_index]);
+              }
+              if (m_doTopoCellCones) {
+                  (m_cutToCaloSamplingIndexToDecorator_TopoCellEnergy.at(cutNumber).at(sampling_index))(*track) = topoCellRings.at(cutNumber, m_caloSamplingNumbers[sampling_index]);
+              }
+              if (m_cellSignificanceCut >= 0) {
+                  (m_cutToCaloSamplingIndexToDecorator_SignificantCellEnergy.at(cutNumber).at(sampling_index))(*track) = significantCellRings.at(cutNumber, m_caloSamplingNumbers[sampling_index]);
+              }
           }
       }//close loop over cut names
     } // loop trackContainer
     return StatusCode::SUCCESS;
   }
-  void TrackCaloDecorator::getHitsSum(const CaloCalibrationHitContainer* hits,const  xAOD::CaloCluster* cl,  unsigned int particle_barcode, std::vector< std::vector<float> >& hitsMap) const {
-       //Sum all of the calibration hits in all of the layers, and return a map of calo layer to energy sum
-       if (hits == NULL)
-       {
-           return;
-       }
-
-       if (particle_barcode == 0){
-           return;
-       }
-
-       const CaloClusterCellLink* cellLinks=cl->getCellLinks();
-       if ((cellLinks != NULL)){
-           CaloClusterCellLink::const_iterator lnk_it=cellLinks->begin();
-           CaloClusterCellLink::const_iterator lnk_it_e=cellLinks->end();
-           for (;lnk_it!=lnk_it_e;++lnk_it) {
-               const CaloCell* cell=*lnk_it;
-               CaloCell_ID::CaloSample cellLayer = cell->caloDDE()->getSampling();
-               //std::cout<< "   ID=" << std::hex << cell->ID() << std::dec << ", E=" << cell->e() << ", weight=" << lnk_it.weight() << std::endl;
-               CaloCalibrationHitContainer::const_iterator it;
-               //Can we find a corresponding calibration hit for this cell?
-               for(it = hits->begin(); it!=hits->end(); it++) {
-                   const CaloCalibrationHit* hit = *it;
-                   if ((cell->ID() == hit->cellID()) and (particle_barcode == hit->particleID())){
-                       unsigned int cell_layer_index = m_mapCaloSamplingToIndex.at(((CaloSampling::CaloSample)(cellLayer)));
-                       hitsMap[0][cell_layer_index] += hit->energyEM();
-                       hitsMap[1][cell_layer_index] += hit->energyNonEM();
-                       hitsMap[2][cell_layer_index] += hit->energyInvisible();
-                       hitsMap[3][cell_layer_index] += hit->energyEscaped();
-                   }
-               }
-           }
-       }
-    }
-
-      void TrackCaloDecorator::getHitsSumAllBackground(const CaloCalibrationHitContainer* hits, const xAOD::CaloCluster* cl,  unsigned int particle_barcode, const xAOD::TruthParticleContainer* truthParticles, std::vector<int> sumForThesePDGIDs, std::vector<int> skipThesePDGIDs,  std::vector< std::vector<float> >& hitsMap) const {
-      //Sum all of the calibration hits in all of the layers, and return a map of calo layer to energy sum
-      //Gather all of the information pertaining to the total energy deposited in the cells of this cluster
-      if (particle_barcode == 0) return;
 
-      if (hits == NULL)
-      {
-          std::cout<<"hits container was null"<<std::endl;
-          return;
+  std::shared_ptr<const CaloCellGeometryTable> TrackCaloDecorator::cellGeometryTable(const CaloDetDescrManager* caloMgr) const {
+    std::lock_guard<std::mutex> lock(m_cellGeometryMutex);
+    if (!m_cellGeometry || caloMgr != m_cellGeometryManager) {
+      ATH_MSG_DEBUG("Building the cell geometry table");
+      auto table = std::make_shared<CaloCellGeometryTable>(m_cellGridBinSize, m_nsamplings);
+      table->build(*caloMgr);
+      m_cellGeometry = table;
+      m_cellGeometryManager = caloMgr;
+    }
+    return m_cellGeometry;
+  }
+
+  bool TrackCaloDecorator::passesPreselection(const xAOD::TrackParticle* track, const xAOD::Vertex* primaryVertex) const {
+    //Each requirement is disabled when its threshold is negative
+    if (m_trackMinPt >= 0 && track->pt() < m_trackMinPt) return false;
+    if (m_trackMaxAbsEta >= 0 && std::fabs(track->eta()) > m_trackMaxAbsEta) return false;
+
+    if (m_trackMinPixelHits >= 0 || m_trackMinSiHits >= 0) {
+      uint8_t nPixelHits = 0;
+      uint8_t nSCTHits = 0;
+      if (!track->summaryValue(nPixelHits, xAOD::numberOfPixelHits)) nPixelHits = 0;
+      if (!track->summaryValue(nSCTHits, xAOD::numberOfSCTHits)) nSCTHits = 0;
+      if (m_trackMinPixelHits >= 0 && nPixelHits < m_trackMinPixelHits) return false;
+      if (m_trackMinSiHits >= 0 && nPixelHits + nSCTHits < m_trackMinSiHits) return false;
+    }
+
+    //Association to the hard-scatter vertex: either the track was used in its fit, or it is compatible with it in z0 sin(theta)
+    if (m_trackMaxZ0SinTheta >= 0) {
+      if (!primaryVertex) return false;
+      if (track->vertex() != primaryVertex) {
+        double deltaZ0 = track->z0() + track->vz() - primaryVertex->z();
+        if (std::fabs(deltaZ0 * std::sin(track->theta())) > m_trackMaxZ0SinTheta) return false;
       }
+    }
+    return true;
+  }
 
-      const CaloClusterCellLink* cellLinks=cl->getCellLinks();
-      if ((cellLinks != NULL)){
-          CaloCalibrationHitContainer::const_iterator it;
-          const CaloCalibrationHit* hit = nullptr;
-
-          for(it = hits->begin(); it!=hits->end(); it++) {
-              hit = *it;
-
-              //check if the hit is for the track particle. If it is from the track particle, it isn't background. Don't sum the energy deposits for it.
-              unsigned int hitID = hit->particleID();
-              if (hitID == particle_barcode){continue;}
-
-              //check that the hit was in the cluster
-              bool hitInCluster = false;
-              CaloClusterCellLink::const_iterator lnk_it=cellLinks->begin();
-              CaloClusterCellLink::const_iterator lnk_it_e=cellLinks->end();
-              CaloCell_ID::CaloSample cellLayer;
-              for (;lnk_it!=lnk_it_e;++lnk_it) {
-                  const CaloCell* cell=*lnk_it;
-                  if (cell->ID() == hit->cellID()){
-                      hitInCluster=true;
-                      cellLayer = cell->caloDDE()->getSampling();
-                      break;
-                  }
-              }
-              if (not hitInCluster){continue;}
+  void TrackCaloDecorator::fillHelixImpacts(const xAOD::TrackParticle* track, std::size_t trackIndex, bool applyCorrection, TrackImpactTable& impactTable) const {
+    //The perigee parameters are expressed with respect to the reference point of the track
+    HelixCaloExtrapolator::Track helixTrack;
+    helixTrack.x = track->vx() - track->d0() * std::sin(track->phi0());
+    helixTrack.y = track->vy() + track->d0() * std::cos(track->phi0());
+    helixTrack.z = track->vz() + track->z0();
+    helixTrack.phi0 = track->phi0();
+    helixTrack.theta = track->theta();
+    helixTrack.qOverP = track->qOverP();
+    HelixCaloExtrapolator::State state = m_helixExtrapolator->exitSolenoid(helixTrack);
+    for (unsigned int sampling = 0; sampling < m_nsamplings; sampling++) {
+      float eta = 0.0, phi = 0.0;
+      if (m_helixExtrapolator->intersect(state, sampling, applyCorrection, eta, phi)) impactTable.set(trackIndex, sampling, eta, phi);
+    }
+  }
 
-              //loop through the truth particle container, and find the pdg of the truth particle that caused the hit
-              int pdgIDHit = 0;
-              for(const auto& truthPart: *truthParticles){
-                  unsigned int truthPartBarcode = truthPart->barcode();
-                  if (hitID == truthPartBarcode){pdgIDHit = truthPart->pdgId(); break;} 
-              }
-              if (pdgIDHit == 0){ATH_MSG_WARNING("Warning, couldn't find a truth particle for this hit");}
-
-              //Check if this is a PDG ID that should be summed
-              //bool shouldSum = true;
-              if (sumForThesePDGIDs.size() != 0){
-                  if (std::find(sumForThesePDGIDs.begin(), sumForThesePDGIDs.end(), pdgIDHit) == sumForThesePDGIDs.end()){
-                      //shouldSum = false;
-                      continue;
-                  }
-              }
-              //Check if this is a PDG ID that should be skipped
-              else if (skipThesePDGIDs.size() != 0){
-                  if (std::find(skipThesePDGIDs.begin(), skipThesePDGIDs.end(), pdgIDHit) != skipThesePDGIDs.end()){
-                      //shouldSum = false;
-                      continue;
-                  }
-              }
-              unsigned int cell_layer_index = m_mapCaloSamplingToIndex.at(((CaloSampling::CaloSample)(cellLayer)));
+  void TrackCaloDecorator::setNominalSamplingSurfaces(HelixCaloExtrapolator& helix) const {
+    //Approximate depth (mm) and |eta| coverage of each sampling. The residual offsets are absorbed by the correction table.
+    helix.setBarrelSurface(CaloSampling::PreSamplerB, 1422, 0.0, 1.52);
+    helix.setBarrelSurface(CaloSampling::EMB1, 1532, 0.0, 1.475);
+    helix.setBarrelSurface(CaloSampling::EMB2, 1790, 0.0, 1.475);
+    helix.setBarrelSurface(CaloSampling::EMB3, 1975, 0.0, 1.475);
+    helix.setEndcapSurface(CaloSampling::PreSamplerE, 3680, 1.5, 1.8);
+    helix.setEndcapSurface(CaloSampling::EME1, 3760, 1.375, 3.2);
+    helix.setEndcapSurface(CaloSampling::EME2, 3880, 1.375, 3.2);
+    helix.setEndcapSurface(CaloSampling::EME3, 4100, 1.5, 2.5);
+    helix.setEndcapSurface(CaloSampling::HEC0, 4400, 1.5, 3.2);
+    helix.setEndcapSurface(CaloSampling::HEC1, 4950, 1.5, 3.2);
+    helix.setEndcapSurface(CaloSampling::HEC2, 5500, 1.5, 3.2);
+    helix.setEndcapSurface(CaloSampling::HEC3, 6050, 1.5, 3.2);
+    helix.setBarrelSurface(CaloSampling::TileBar0, 2450, 0.0, 1.0);
+    helix.setBarrelSurface(CaloSampling::TileBar1, 2995, 0.0, 1.0);
+    helix.setBarrelSurface(CaloSampling::TileBar2, 3630, 0.0, 0.9);
+    helix.setBarrelSurface(CaloSampling::TileGap1, 3215, 0.8, 1.0);
+    helix.setBarrelSurface(CaloSampling::TileGap2, 2650, 0.85, 1.0);
+    helix.setEndcapSurface(CaloSampling::TileGap3, 3510, 1.0, 1.6);
+    helix.setBarrelSurface(CaloSampling::TileExt0, 2450, 0.8, 1.7);
+    helix.setBarrelSurface(CaloSampling::TileExt1, 2995, 0.8, 1.6);
+    helix.setBarrelSurface(CaloSampling::TileExt2, 3630, 0.8, 1.3);
+    helix.setEndcapSurface(CaloSampling::FCAL0, 4900, 3.1, 4.9);
+    helix.setEndcapSurface(CaloSampling::FCAL1, 5350, 3.1, 4.9);
+    helix.setEndcapSurface(CaloSampling::FCAL2, 5800, 3.1, 4.9);
+  }
+
+  void TrackCaloDecorator::fillClusterSnapshot(const xAOD::CaloClusterContainer* clusters, CaloClusterSnapshot& snapshot) const {
+    snapshot.resize(clusters->size(), m_nsamplings);
+
+    unsigned int clusterIndex = 0;
+    for (const auto& cluster : *clusters) {
+      snapshot.rawEta[clusterIndex] = cluster->rawEta();
+      snapshot.rawPhi[clusterIndex] = cluster->rawPhi();
+      snapshot.rawE[clusterIndex] = cluster->rawE();
+      snapshot.calEta[clusterIndex] = cluster->calEta();
+      snapshot.calPhi[clusterIndex] = cluster->calPhi();
+      snapshot.calE[clusterIndex] = cluster->calE();
+      snapshot.e[clusterIndex] = cluster->e();
+
+      float* sampleEnergy = snapshot.eSampleRow(clusterIndex);
+      for (unsigned int sampling = 0; sampling < m_nsamplings; sampling++) {
+        sampleEnergy[sampling] = cluster->eSample((CaloSampling::CaloSample)(sampling));
+      }
+
+      /*Finding the most energetic layer of the cluster*/
+      unsigned int mostEnergeticLayer = xAOD::CaloCluster::CaloSample::Unknown;
+      double maxLayerClusterEnergy = -999999999; //Some extremely low value
+      for (unsigned int i=0; i<xAOD::CaloCluster::CaloSample::TileExt2+1; i++) {
+        if(sampleEnergy[i] > maxLayerClusterEnergy) {
+          maxLayerClusterEnergy = sampleEnergy[i];
+          mostEnergeticLayer = i;
+        }
+      }
+      snapshot.maxEnergyLayer[clusterIndex] = mostEnergeticLayer;
+      snapshot.maxLayerEnergy[clusterIndex] = maxLayerClusterEnergy;
+
+      //Every cluster of the container is read here, so the missing moments are only counted, and reported once at finalize
+      double moment = 0.0;
+      bool missingMoment = false;
+      if (cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 501, moment)) {snapshot.lambdaCenter[clusterIndex] = moment;}
+      else {ATH_MSG_DEBUG("Couldn't retrieve the cluster lambda center"); missingMoment = true;}
+      if (cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 900, moment)) {snapshot.emProbability[clusterIndex] = moment;}
+      else {ATH_MSG_DEBUG("Couldn't rertieve the EM Probability"); missingMoment = true;}
+      if (cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 804, moment)) {snapshot.firstEnergyDensity[clusterIndex] = moment;}
+      else {ATH_MSG_DEBUG("Couldn't rertieve the first energy density moment"); missingMoment = true;}
+      if (cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 303, moment)) {snapshot.deltaAlpha[clusterIndex] = moment;}
+      else {ATH_MSG_DEBUG("Couldn't rertieve the delta alpha moment"); missingMoment = true;}
+      //The second radial moment has always been filled from moment 202, like the second lambda
+      if (cluster->retrieveMoment((xAOD::CaloCluster_v1::MomentType) 202, moment)) {snapshot.secondLambda[clusterIndex] = moment;}
+      else {ATH_MSG_DEBUG("Couldn't rertieve the second lambda moment"); missingMoment = true;}
+      if (missingMoment) m_clustersWithoutMoments++;
+
+      clusterIndex += 1;
+    }
+  }
 
-              //std::cout<<"PDG ID = "<<pdgIDHit<< "   ID=" << std::hex << cell->ID() << std::dec << ", E=" << cell->e() << ", weight=" << lnk_it.weight() << std::endl;
-              hitsMap[0][cell_layer_index]+=hit->energyEM();
-              hitsMap[1][cell_layer_index]+=hit->energyNonEM();
-              hitsMap[2][cell_layer_index]+=hit->energyInvisible();
-              hitsMap[3][cell_layer_index]+=hit->energyEscaped();
+  void TrackCaloDecorator::sumClusterHits(const CalibrationHitIndex& hits, unsigned int hitKind, const ClusterCellTable& clusterCells, unsigned int clusterIndex, unsigned int particle_barcode, const TruthBarcodeTable& truthBarcodes, CalibrationHitBreakdown& breakdown) const {
+      //Sum the calibration hits in the cells of this cluster in a single pass, attributing each hit to the signal particle
+      //or to one of the background categories
+      if (particle_barcode == 0) return;
+
+      for (const ClusterCellTable::Member* cell = clusterCells.begin(clusterIndex); cell != clusterCells.end(clusterIndex); ++cell) {
+          std::size_t firstHit = 0;
+          std::size_t lastHit = 0;
+          if (!hits.cellHits(cell->cellID, firstHit, lastHit)) continue;
+          for (std::size_t i = firstHit; i < lastHit; i++) {
+              unsigned int hitID = hits.cellHitBarcode(i);
+              unsigned int category = s_signalHits;
+              if (hitID != particle_barcode) {
+                  //find the class of the truth particle that caused the hit, and the first background category containing it
+                  PdgCategory::Class pdgClass = truthBarcodes.pdgClass(hitID);
+                  if (pdgClass == PdgCategory::Unknown){ATH_MSG_WARNING("Warning, couldn't find a truth particle for this hit");}
+                  category = m_pdgClassToHitCategory[pdgClass];
+                  if (category == s_unassignedHits) continue;
+              }
+              breakdown.addHit(hitKind, category, cell->sampling, hits.cellHitEnergies(i).energy);
           }
-     }
+      }
   }
 } // Derivation Framework
@@ -0,0 +1,22 @@
+#include "DerivationFrameworkEoverP/TruthBarcodeTable.h"
+
+namespace DerivationFramework {
+
+  void TruthBarcodeTable::build(const xAOD::TruthParticleContainer* truthParticles) {
+    m_entries.clear();
+    if (!truthParticles) return;
+    m_entries.reserve(truthParticles->size());
+    unsigned int index = 0;
+    for (const xAOD::TruthParticle* truthPart : *truthParticles) {
+      unsigned int barcode = truthPart->barcode();
+      if (!m_entries.find(barcode)) {
+        Entry& entry = m_entries[barcode];
+        entry.pdgId = truthPart->pdgId();
+        entry.pdgClass = PdgCategory::classify(entry.pdgId);
+        entry.index = index;
+      }
+      index++;
+    }
+  }
+
+} // Derivation Framework
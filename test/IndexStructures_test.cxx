@@ -0,0 +1,230 @@
+/*
+ * @file     IndexStructures_test.cxx
+ * @brief    Unit tests of the per-event lookup structures of TrackCaloDecorator: FlatHashMap with clustered keys,
+ *           the CalibrationHitIndex round trip and the phi wrap-around of EtaPhiGridIndex against a brute-force search.
+ */
+#undef NDEBUG
+
+#include "DerivationFrameworkEoverP/FlatHashMap.h"
+#include "DerivationFrameworkEoverP/CalibrationHitIndex.h"
+#include "DerivationFrameworkEoverP/EtaPhiGridIndex.h"
+#include "CaloSimEvent/CaloCalibrationHitContainer.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace DerivationFramework;
+
+namespace {
+
+  //Mean number of slots visited per insertion, with the slot choice and the capacity of FlatHashMap after reserve(n)
+  template <typename Hash>
+  double meanProbeLength(const std::vector<std::uint64_t>& keys) {
+    std::size_t capacity = 16;
+    while (capacity < 2 * keys.size()) capacity *= 2;
+    std::vector<unsigned char> used(capacity, 0);
+    double probes = 0;
+    for (std::uint64_t key : keys) {
+      std::size_t slot = Hash()(key) & (capacity - 1);
+      probes += 1;
+      while (used[slot]) {
+        slot = (slot + 1) & (capacity - 1);
+        probes += 1;
+      }
+      used[slot] = 1;
+    }
+    return probes / keys.size();
+  }
+
+  struct IdentityHash {
+    std::size_t operator()(std::uint64_t h) const {return h;}
+  };
+
+  //Compact identifiers that differ only in their high bits, like the calorimeter cell identifiers
+  std::vector<std::uint64_t> cellLikeKeys(unsigned int n) {
+    std::vector<std::uint64_t> keys;
+    for (unsigned int i = 0; i < n; i++) keys.push_back(0x3480000000000000ULL + ((std::uint64_t)i << 40));
+    return keys;
+  }
+
+  //Primary barcodes 1..nPrimaries and secondary barcodes from 200001
+  std::vector<std::uint64_t> barcodeLikeKeys(unsigned int nPrimaries, unsigned int nSecondaries) {
+    std::vector<std::uint64_t> keys;
+    for (unsigned int i = 1; i <= nPrimaries; i++) keys.push_back(i);
+    for (unsigned int i = 0; i < nSecondaries; i++) keys.push_back(200001 + i);
+    return keys;
+  }
+
+  void checkMap(const std::vector<std::uint64_t>& keys) {
+    FlatHashMap<std::uint64_t, unsigned int> map;
+    //no reserve: the map has to grow
+    for (std::size_t i = 0; i < keys.size(); i++) map[keys[i]] = i;
+    assert(map.size() == keys.size());
+    for (std::size_t i = 0; i < keys.size(); i++) {
+      const unsigned int* value = map.find(keys[i]);
+      assert(value && *value == i);
+    }
+    assert(!map.find(0x1234567ULL));
+    map.clear();
+    assert(map.size() == 0);
+    assert(!map.find(keys.front()));
+    map.reserve(keys.size());
+    map[keys.back()] += 3;
+    assert(map.size() == 1 && *map.find(keys.back()) == 3);
+  }
+
+  Identifier cellID(std::uint64_t compact) {return Identifier((Identifier::value_type)compact);}
+
+  bool near(float a, float b) {return std::fabs(a - b) <= 1e-4 * (1 + std::fabs(b));}
+
+} // anonymous namespace
+
+void testFlatHashMap() {
+  std::cout << "testFlatHashMap\n";
+  std::vector<std::uint64_t> cells = cellLikeKeys(20000);
+  std::vector<std::uint64_t> barcodes = barcodeLikeKeys(8000, 100000);
+  std::vector<std::uint64_t> packed;
+  for (unsigned int cluster = 0; cluster < 200; cluster++) {
+    for (unsigned int barcode = 1; barcode <= 50; barcode++) packed.push_back(((std::uint64_t)cluster << 32) | barcode);
+  }
+
+  checkMap(cells);
+  checkMap(barcodes);
+  checkMap(packed);
+
+  //With the identity, the cell-like keys all start from the same slot. The default hash must keep the probes short.
+  typedef FlatHashMap<std::uint64_t, unsigned int>::hasher DefaultHash;
+  typedef FlatHashMap<unsigned int, unsigned int>::hasher DefaultBarcodeHash;
+  assert(meanProbeLength<IdentityHash>(cells) > 100);
+  assert(meanProbeLength<DefaultHash>(cells) < 3);
+  assert(meanProbeLength<DefaultBarcodeHash>(barcodes) < 3);
+  assert(meanProbeLength<DefaultHash>(packed) < 3);
+}
+
+void testCalibrationHitIndex() {
+  std::cout << "testCalibrationHitIndex\n";
+  CalibrationHitIndex index;
+  index.build(nullptr);
+  assert(index.size() == 0);
+
+  std::vector<std::uint64_t> cells = cellLikeKeys(500);
+  CaloCalibrationHitContainer hits("TestCalibrationHits");
+  for (std::size_t i = 0; i < cells.size(); i++) {
+    for (unsigned int barcode = 1; barcode <= 3; barcode++) {
+      hits.push_back(new CaloCalibrationHit(cellID(cells[i]), 1.0 * barcode, 2.0, 3.0, 4.0 * i, barcode));
+    }
+    //a second hit of the same particle in the same cell is summed with the first one
+    hits.push_back(new CaloCalibrationHit(cellID(cells[i]), 0.5, 0.25, 0.0, 0.0, 2));
+  }
+  index.build(&hits);
+  assert(index.size() == 3 * cells.size());
+
+  for (std::size_t i = 0; i < cells.size(); i++) {
+    for (unsigned int barcode = 1; barcode <= 3; barcode++) {
+      const CalibrationHitEnergies* energies = index.find(cellID(cells[i]), barcode);
+      assert(energies);
+      float extraEM = barcode == 2 ? 0.5 : 0.0;
+      float extraNonEM = barcode == 2 ? 0.25 : 0.0;
+      assert(near(energies->energy[0], 1.0 * barcode + extraEM));
+      assert(near(energies->energy[1], 2.0 + extraNonEM));
+      assert(near(energies->energy[2], 3.0));
+      assert(near(energies->energy[3], 4.0 * i));
+    }
+    assert(!index.find(cellID(cells[i]), 4));
+  }
+  assert(!index.find(cellID(0x1000000000000000ULL), 1));
+
+  //The summed hits of a cell list each of its particles once
+  for (std::size_t i = 0; i < cells.size(); i++) {
+    std::size_t first = 0, last = 0;
+    assert(index.cellHits(cells[i], first, last));
+    assert(last - first == 3);
+    std::set<unsigned int> cellBarcodes;
+    for (std::size_t j = first; j < last; j++) {
+      cellBarcodes.insert(index.cellHitBarcode(j));
+      assert(near(index.cellHitEnergies(j).energy[3], 4.0 * i));
+    }
+    assert(cellBarcodes.size() == 3 && *cellBarcodes.begin() == 1 && *cellBarcodes.rbegin() == 3);
+  }
+  std::size_t first = 0, last = 0;
+  assert(!index.cellHits(0x1000000000000000ULL, first, last));
+
+  //Rebuilding replaces the previous event
+  CaloCalibrationHitContainer otherHits("TestCalibrationHits");
+  otherHits.push_back(new CaloCalibrationHit(cellID(cells[0]), 7.0, 0.0, 0.0, 0.0, 9));
+  index.build(&otherHits);
+  assert(index.size() == 1);
+  assert(!index.find(cellID(cells[0]), 1));
+  assert(index.find(cellID(cells[0]), 9) && near(index.find(cellID(cells[0]), 9)->energy[0], 7.0));
+  assert(index.cellHits(cells[0], first, last) && last - first == 1 && index.cellHitBarcode(first) == 9);
+  assert(!index.cellHits(cells[1], first, last));
+}
+
+void testEtaPhiGridIndex() {
+  std::cout << "testEtaPhiGridIndex\n";
+  std::mt19937 generator(12345);
+  std::uniform_real_distribution<float> etaDistribution(-3.0, 3.0);
+  std::uniform_real_distribution<float> phiDistribution(-M_PI, M_PI);
+  std::uniform_real_distribution<float> edgeDistribution(-0.05, 0.05);
+
+  const unsigned int nPartitions = 3;
+  const std::size_t n = 5000;
+  std::vector<float> eta(n), phi(n);
+  std::vector<unsigned int> partition(n);
+  for (std::size_t i = 0; i < n; i++) {
+    eta[i] = etaDistribution(generator);
+    //a quarter of the objects sit next to phi = +-pi
+    if (i % 4 == 0) {
+      float edge = edgeDistribution(generator);
+      phi[i] = edge > 0 ? -M_PI + edge : M_PI + edge;
+    }
+    else phi[i] = phiDistribution(generator);
+    //a few objects are outside of the partitions and must not be indexed
+    partition[i] = i % 101 == 0 ? nPartitions : i % nPartitions;
+  }
+
+  EtaPhiGridIndex grid(0.1, 5.0, nPartitions);
+  grid.build(n, eta.data(), phi.data(), partition.data());
+  std::size_t nIndexed = 0;
+  for (std::size_t i = 0; i < n; i++) nIndexed += partition[i] < nPartitions;
+  assert(grid.size() == nIndexed);
+
+  const float radii[] = {0.05, 0.2, 0.4, 4.0};
+  std::vector<unsigned int> candidates;
+  for (unsigned int query = 0; query < 2000; query++) {
+    float queryEta = etaDistribution(generator);
+    float queryPhi = phiDistribution(generator);
+    if (query % 2 == 0) {
+      float edge = edgeDistribution(generator);
+      queryPhi = edge > 0 ? -M_PI + edge : M_PI + edge;
+    }
+    float radius = radii[query % 4];
+    unsigned int queryPartition = query % nPartitions;
+
+    candidates.clear();
+    grid.query(queryEta, queryPhi, radius, queryPartition, candidates);
+    std::set<unsigned int> found(candidates.begin(), candidates.end());
+    //every object is returned at most once, and only from the queried partition
+    assert(found.size() == candidates.size());
+    for (unsigned int i : candidates) assert(partition[i] == queryPartition);
+
+    for (std::size_t i = 0; i < n; i++) {
+      if (partition[i] != queryPartition) continue;
+      float deltaPhi = std::remainder(phi[i] - queryPhi, 2 * M_PI);
+      float deltaEta = eta[i] - queryEta;
+      if (deltaEta * deltaEta + deltaPhi * deltaPhi < radius * radius) assert(found.count(i));
+    }
+  }
+}
+
+int main() {
+  testFlatHashMap();
+  testCalibrationHitIndex();
+  testEtaPhiGridIndex();
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * @file     benchDeltaRKernel.cxx
+ * @brief    Micro-benchmark of the deltaR cone-bin assignment: the original per-pair sqrt and std::map walk,
+ *           the scalar kernel and the AVX2 kernel. Also checks that the scalar and AVX2 kernels agree.
+ *
+ * Usage: benchDeltaRKernel [nObjects] [nRepetitions]
+ */
+#include "DerivationFrameworkEoverP/DeltaRKernel.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace DRK = DerivationFramework::DeltaRKernel;
+
+int main(int argc, char** argv) {
+  std::size_t nObjects = argc > 1 ? std::atol(argv[1]) : 20000;
+  unsigned int nRepetitions = argc > 2 ? std::atoi(argv[2]) : 500;
+
+  //The twelve default cones
+  std::map<unsigned int, float> cutNumberToCut;
+  std::vector<float> coneSizeSquared;
+  for (unsigned int cone = 0; cone < 12; cone++) {
+    float cut = 0.025 * (cone + 1);
+    cutNumberToCut[cone] = cut;
+    coneSizeSquared.push_back(cut * cut);
+  }
+
+  //Objects in a window around the track, as after the grid preselection
+  std::mt19937 rng(4321);
+  std::uniform_real_distribution<float> etaDist(-0.4, 0.4);
+  std::uniform_real_distribution<float> phiDist(-M_PI, M_PI);
+  std::vector<float> eta(nObjects), phi(nObjects);
+  for (std::size_t i = 0; i < nObjects; i++) {eta[i] = etaDist(rng); phi[i] = phiDist(rng);}
+  const float trackEta = 0.0;
+  const float trackPhi = 3.0; //close to the phi boundary, so that both wrap-around directions are exercised
+
+  std::vector<int> bins(nObjects), binsAVX2(nObjects);
+  std::vector<float> deltaR2(nObjects), deltaR2AVX2(nObjects);
+  unsigned long checksum = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int rep = 0; rep < nRepetitions; rep++) {
+    for (std::size_t i = 0; i < nObjects; i++) {
+      double etaDiff = eta[i] - trackEta;
+      double phiDiff = phi[i] - trackPhi;
+      if (phiDiff > M_PI) phiDiff = 2 * M_PI - phiDiff;
+      double deltaR = std::sqrt((etaDiff*etaDiff) + (phiDiff*phiDiff));
+      unsigned int bin = cutNumberToCut.size();
+      for (const auto& cut : cutNumberToCut) {
+        if (deltaR < cutNumberToCut.at(cut.first)) {bin = cut.first; break;}
+      }
+      checksum += bin;
+    }
+  }
+  double naiveSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (unsigned int rep = 0; rep < nRepetitions; rep++) {
+    DRK::coneBinsScalar(eta.data(), phi.data(), nObjects, trackEta, trackPhi, coneSizeSquared.data(), coneSizeSquared.size(), bins.data(), deltaR2.data());
+    checksum += bins[rep % nObjects];
+  }
+  double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  for (unsigned int rep = 0; rep < nRepetitions; rep++) {
+    DRK::coneBinsAVX2(eta.data(), phi.data(), nObjects, trackEta, trackPhi, coneSizeSquared.data(), coneSizeSquared.size(), binsAVX2.data(), deltaR2AVX2.data());
+    checksum += binsAVX2[rep % nObjects];
+  }
+  double avx2Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (std::size_t i = 0; i < nObjects; i++) {
+    if (bins[i] != binsAVX2[i] || deltaR2[i] != deltaR2AVX2[i]) {
+      std::printf("Scalar and AVX2 kernels disagree for object %zu: bin %d vs %d\n", i, bins[i], binsAVX2[i]);
+      return 1;
+    }
+  }
+
+  double pairs = (double)nObjects * nRepetitions;
+  std::printf("AVX2 available: %s (checksum %lu)\n", DRK::hasAVX2() ? "yes" : "no", checksum);
+  std::printf("%-26s %12.1f Mpairs/s\n", "sqrt + std::map walk", 1e-6 * pairs / naiveSeconds);
+  std::printf("%-26s %12.1f Mpairs/s\n", "scalar kernel", 1e-6 * pairs / scalarSeconds);
+  std::printf("%-26s %12.1f Mpairs/s\n", "AVX2 kernel", 1e-6 * pairs / avx2Seconds);
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * @file     benchEtaPhiGridIndex.cxx
+ * @brief    Throughput of track-cluster matching with and without the per-event eta-phi grid,
+ *           as a function of the cluster multiplicity. Clusters and track positions are generated
+ *           uniformly in |eta| < 4.9, so the numbers are a lower bound for the real (jetty) events.
+ *
+ * Usage: benchEtaPhiGridIndex [nTracks] [nEvents]
+ */
+#include "DerivationFrameworkEoverP/EtaPhiGridIndex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using DerivationFramework::EtaPhiGridIndex;
+
+namespace {
+  const float coneSize = 0.3;
+
+  bool matches(float clEta, float clPhi, float trkEta, float trkPhi) {
+    float etaDiff = clEta - trkEta;
+    float phiDiff = std::fabs(clPhi - trkPhi);
+    if (phiDiff > M_PI) phiDiff = 2 * M_PI - phiDiff;
+    return etaDiff * etaDiff + phiDiff * phiDiff < coneSize * coneSize;
+  }
+}
+
+int main(int argc, char** argv) {
+  unsigned int nTracks = argc > 1 ? std::atoi(argv[1]) : 500;
+  unsigned int nEvents = argc > 2 ? std::atoi(argv[2]) : 20;
+
+  std::mt19937 rng(12345);
+  std::uniform_real_distribution<float> etaDist(-4.9, 4.9);
+  std::uniform_real_distribution<float> phiDist(-M_PI, M_PI);
+
+  std::printf("%10s %16s %16s %16s %10s\n", "nClusters", "bruteForce[ev/s]", "grid[ev/s]", "gridBuild[us]", "speedup");
+
+  for (unsigned int nClusters : {250u, 500u, 1000u, 2000u, 4000u, 8000u, 16000u}) {
+    double bruteSeconds = 0;
+    double gridSeconds = 0;
+    double buildSeconds = 0;
+    unsigned long bruteMatches = 0;
+    unsigned long gridMatches = 0;
+
+    for (unsigned int event = 0; event < nEvents; event++) {
+      std::vector<float> clEta(nClusters), clPhi(nClusters);
+      for (unsigned int i = 0; i < nClusters; i++) {clEta[i] = etaDist(rng); clPhi[i] = phiDist(rng);}
+      std::vector<float> trkEta(nTracks), trkPhi(nTracks);
+      for (unsigned int i = 0; i < nTracks; i++) {trkEta[i] = etaDist(rng); trkPhi[i] = phiDist(rng);}
+
+      auto start = std::chrono::steady_clock::now();
+      for (unsigned int t = 0; t < nTracks; t++) {
+        for (unsigned int c = 0; c < nClusters; c++) {
+          if (matches(clEta[c], clPhi[c], trkEta[t], trkPhi[t])) bruteMatches += 1;
+        }
+      }
+      auto stop = std::chrono::steady_clock::now();
+      bruteSeconds += std::chrono::duration<double>(stop - start).count();
+
+      start = std::chrono::steady_clock::now();
+      EtaPhiGridIndex grid(0.1);
+      grid.build(nClusters, clEta.data(), clPhi.data());
+      auto built = std::chrono::steady_clock::now();
+      std::vector<unsigned int> candidates;
+      for (unsigned int t = 0; t < nTracks; t++) {
+        candidates.clear();
+        grid.query(trkEta[t], trkPhi[t], coneSize, 0, candidates);
+        for (unsigned int c : candidates) {
+          if (matches(clEta[c], clPhi[c], trkEta[t], trkPhi[t])) gridMatches += 1;
+        }
+      }
+      stop = std::chrono::steady_clock::now();
+      gridSeconds += std::chrono::duration<double>(stop - start).count();
+      buildSeconds += std::chrono::duration<double>(built - start).count();
+    }
+
+    if (bruteMatches != gridMatches) {
+      std::printf("Mismatch for %u clusters: brute force found %lu matches, grid found %lu\n", nClusters, bruteMatches, gridMatches);
+      return 1;
+    }
+    std::printf("%10u %16.1f %16.1f %16.1f %10.1f\n", nClusters, nEvents / bruteSeconds, nEvents / gridSeconds,
+                1e6 * buildSeconds / nEvents, bruteSeconds / gridSeconds);
+  }
+  return 0;
+}